@@ -1,97 +1,218 @@
 #include "csim.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+// Number of accesses whose set indices are hashed together in access_batch
+static const size_t HASH_BATCH = 256;
+
+// Parse an index mode name
+bool parse_index_mode(const std::string& name, IndexMode& mode) {
+    if (name == "bits") mode = IndexMode::BITS;
+    else if (name == "xor") mode = IndexMode::XOR;
+    else if (name == "prime") mode = IndexMode::PRIME;
+    else if (name == "skew") mode = IndexMode::SKEW;
+    else return false;
+    return true;
+}
+
+static const char* index_mode_name(IndexMode mode) {
+    switch (mode) {
+    case IndexMode::XOR: return "xor";
+    case IndexMode::PRIME: return "prime";
+    case IndexMode::SKEW: return "skew";
+    default: return "bits";
+    }
+}
+
+// Largest prime <= n (1 for n < 2)
+static uint32_t largest_prime_at_most(uint32_t n) {
+    for (uint32_t p = n; p >= 2; p--) {
+        bool prime = true;
+        for (uint32_t d = 2; d * d <= p && prime; d++)
+            prime = (p % d != 0);
+        if (prime) return p;
+    }
+    return 1;
+}
 
 // Block implementation
-Block::Block() : tag(0), valid(false), dirty(false), load_ts(0), access_ts(0) {}
+Block::Block() : tag(0), age(0), valid(false), dirty(false) {}
 
 // Set implementation
-Set::Set(uint32_t num_blocks) : blocks(num_blocks) {}
+Set::Set(uint32_t num_blocks) : blocks(num_blocks), clock(0) {}
 
 // Cache implementation
 Cache::Cache(uint32_t sets, uint32_t blocks, uint32_t bytes, 
-      const std::string& policy, bool write_alloc, bool write_thru)
-    : num_sets(sets), block_size(bytes),
-      eviction_policy(policy), write_allocate(write_alloc), 
-      write_through(write_thru), sets(sets, Set(blocks)), timestamp(0) {
+      const std::string& policy, bool write_alloc, bool write_thru,
+      IndexMode mode)
+    : num_sets(sets), num_ways(blocks), block_size(bytes),
+      lru(policy == "lru"), write_allocate(write_alloc), 
+      write_through(write_thru), sets(sets, Set(blocks)),
+      index_mode(mode), set_stats(sets) {
     
     // Calculate bit widths for tag, index, and offset
     offset_bits = log2(block_size);
     index_bits = log2(num_sets);
     tag_bits = 32 - offset_bits - index_bits;
+    index_mask = num_sets - 1;
+
+    // Hashed modes can't recover the block address from the set index,
+    // so they keep all of it as the tag
+    tag_shift = offset_bits + (mode == IndexMode::BITS ? index_bits : 0);
+    prime_sets = largest_prime_at_most(num_sets);
+
+    // Odd multipliers give each way of a skewed cache an independent hash
+    for (uint32_t w = 0; w < num_ways; w++)
+        way_multipliers.push_back(0x9E3779B1u * (2 * w + 1) + 0x85EBCA6Bu * w);
+    way_sets.resize(num_ways);
+}
+
+// Fold every index_bits-wide chunk of the block address together
+uint32_t Cache::xor_fold(uint32_t block_addr) const {
+    uint32_t h = block_addr;
+    for (uint32_t shift = index_bits; shift > 0 && shift < 32; shift += index_bits)
+        h ^= block_addr >> shift;
+    return h & index_mask;
+}
+
+// Multiplicative hash whose top index_bits bits select the set for one way
+uint32_t Cache::skew_hash(uint32_t block_addr, uint32_t way) const {
+    uint32_t h = (block_addr ^ (block_addr >> 16)) * way_multipliers[way];
+    return static_cast<uint32_t>(static_cast<uint64_t>(h) >> (32 - index_bits));
 }
 
 // Extract set index from address
 uint32_t Cache::get_set_index(uint32_t address) const {
-    return (address >> offset_bits) & ((1 << index_bits) - 1);
+    uint32_t block_addr = address >> offset_bits;
+    switch (index_mode) {
+    case IndexMode::XOR: return xor_fold(block_addr);
+    case IndexMode::PRIME: return block_addr % prime_sets;
+    case IndexMode::SKEW: return skew_hash(block_addr, 0);
+    default: return block_addr & index_mask;
+    }
 }
 
 // Extract tag from address
 uint32_t Cache::get_tag(uint32_t address) const {
-    return address >> (offset_bits + index_bits);
+    return address >> tag_shift;
+}
+
+// Compute the set indices of a batch of accesses. The mode is dispatched
+// once per batch so each inner loop is straight-line code the compiler
+// can vectorize.
+void Cache::get_set_indices(const MemAccess* accesses, uint32_t* indices, size_t n) const {
+    switch (index_mode) {
+    case IndexMode::XOR:
+        for (size_t i = 0; i < n; i++)
+            indices[i] = xor_fold(accesses[i].address >> offset_bits);
+        break;
+    case IndexMode::PRIME:
+        for (size_t i = 0; i < n; i++)
+            indices[i] = (accesses[i].address >> offset_bits) % prime_sets;
+        break;
+    case IndexMode::SKEW:
+        // skewed lookups hash once per way in access_skewed
+        break;
+    default:
+        for (size_t i = 0; i < n; i++)
+            indices[i] = (accesses[i].address >> offset_bits) & index_mask;
+        break;
+    }
+}
+
+// Next age in the clock domain of a set
+age_t Cache::next_age(uint32_t set_idx) {
+    uint32_t domain = (index_mode == IndexMode::SKEW) ? 0 : set_idx;
+    if (sets[domain].clock == std::numeric_limits<age_t>::max())
+        renumber_ages(domain);
+    return ++sets[domain].clock;
+}
+
+// Renumber the ages in a clock domain to 1..n, preserving order
+void Cache::renumber_ages(uint32_t domain) {
+    uint32_t first = domain, last = domain + 1;
+    if (index_mode == IndexMode::SKEW) {
+        first = 0;
+        last = num_sets;
+    }
+
+    std::vector<Block*> live;
+    for (uint32_t s = first; s < last; s++)
+        for (auto& block : sets[s].blocks)
+            if (block.valid)
+                live.push_back(&block);
+    std::sort(live.begin(), live.end(), [](const Block* a, const Block* b) {
+        return a->age < b->age;
+    });
+
+    for (size_t i = 0; i < live.size(); i++)
+        live[i]->age = i + 1;
+    sets[domain].clock = live.size();
 }
 
 // Find victim block for eviction through sequential search
 // Should be called only on misses
 Block* Cache::find_victim(Set& set) {
     Block* victim = nullptr;
-    uint32_t min_ts = UINT32_MAX;
     for (auto& block : set.blocks) {
         // If we find an invalid (empty) block, use it immediately as the victim
         if (!block.valid) {
             return &block;
         }
-        if (eviction_policy == "lru") {
-            // LRU (Least Recently Used): evict the block that was accessed longest ago
-            if (block.access_ts < min_ts) {
-                min_ts = block.access_ts;
-                victim = &block;
-            }
-        } else if (eviction_policy == "fifo") {
-            // FIFO (First In First Out): evict the block that was loaded earliest
-            if (block.load_ts < min_ts) {
-                min_ts = block.load_ts;
-                victim = &block;
-            }
+        // The oldest age is the least recently used block (LRU) or the
+        // earliest loaded block (FIFO), depending on when ages are updated
+        if (victim == nullptr || block.age < victim->age) {
+            victim = &block;
         }
     }
     return victim;
 }
 
 // Handle cache miss - load block into cache
-void Cache::handle_miss(Set& set, uint32_t tag, bool is_store) {
+void Cache::handle_miss(Set& set, uint32_t set_idx, uint32_t tag, bool is_store) {
+    // Find a block to evict (invalid block or victim based on policy)
+    Block* victim = find_victim(set);
+    if (victim->valid)
+        set.index.erase(victim->tag);
+    fill_block(victim, set_idx, tag, is_store);
+    set.index[tag] = victim;
+}
+
+// Load a new block over victim, writing back the old one if needed
+void Cache::fill_block(Block* victim, uint32_t set_idx, uint32_t tag, bool is_store) {
     // Update miss statistics and charge memory read cost (100 cycles per 4-byte word)
     (is_store ? stats.store_misses : stats.load_misses)++;
     stats.total_cycles += 100 * (block_size / 4);
+    set_stats[set_idx].misses++;
     
-    // Find a block to evict (invalid block or victim based on policy)
-    Block* victim = find_victim(set);
-    
-    // If evicting a valid block, remove it and writeback if dirty (write-back policy only)
+    // If evicting a valid block, writeback if dirty (write-back policy only)
     if (victim->valid) {
-        set.index.erase(victim->tag);
+        set_stats[set_idx].evictions++;
         if (victim->dirty && !write_through)
             stats.total_cycles += 100 * (block_size / 4);
     }
     
-    // Load new block and set timestamps for LRU/FIFO tracking
+    // Load new block and give it the newest age for LRU/FIFO tracking
     victim->tag = tag;
     victim->valid = true;
-    victim->load_ts = victim->access_ts = timestamp;
+    victim->age = next_age(set_idx);
     victim->dirty = (write_allocate && is_store && !write_through);
     if (write_allocate && is_store && write_through)
         stats.total_cycles += 100;
-    set.index[tag] = victim;
 }
 
 // Handle cache hit
-void Cache::handle_hit(Block* block, bool is_store) {
+void Cache::handle_hit(Block* block, uint32_t set_idx, bool is_store) {
     // Update hit statistics based on operation type
     (is_store ? stats.store_hits : stats.load_hits)++;
     // Cache hit takes 1 cycle to access
     stats.total_cycles += 1;
-     // Update the block's access timestamp for LRU tracking
-    block->access_ts = timestamp;
+    // LRU makes the block the newest in its set; FIFO keeps its load age
+    if (lru)
+        block->age = next_age(set_idx);
 
     // Handle write operations based on write policy
     if (is_store) {
@@ -107,15 +228,38 @@ void Cache::handle_hit(Block* block, bool is_store) {
 
 // Process a memory access
 void Cache::access(uint32_t address, bool is_store) {
+    if (index_mode == IndexMode::SKEW)
+        access_skewed(address, is_store);
+    else
+        access_indexed(address, get_set_index(address), is_store);
+}
+
+// Process a batch of memory accesses
+void Cache::access_batch(const MemAccess* accesses, size_t n) {
+    if (index_mode == IndexMode::SKEW) {
+        for (size_t i = 0; i < n; i++)
+            access_skewed(accesses[i].address, accesses[i].is_store);
+        return;
+    }
+
+    uint32_t indices[HASH_BATCH];
+    for (size_t base = 0; base < n; base += HASH_BATCH) {
+        size_t count = std::min(HASH_BATCH, n - base);
+        get_set_indices(accesses + base, indices, count);
+        for (size_t i = 0; i < count; i++)
+            access_indexed(accesses[base + i].address, indices[i], accesses[base + i].is_store);
+    }
+}
+
+// Process an access whose set index has already been computed
+void Cache::access_indexed(uint32_t address, uint32_t set_idx, bool is_store) {
     // Update overall operation statistics
     if (is_store) {
         stats.total_stores++;
     } else {
         stats.total_loads++;
     }
-    timestamp++;    // Increment global timestamp for tracking access order
-    // Extract set index and tag from the memory address
-    uint32_t set_idx = get_set_index(address);
+    set_stats[set_idx].accesses++;
     uint32_t tag = get_tag(address);
     // Get the corresponding set and check if the tag exists in it
     Set& set = sets[set_idx];
@@ -123,12 +267,12 @@ void Cache::access(uint32_t address, bool is_store) {
 
     if (it != set.index.end()) {
         // Cache hit
-        handle_hit(it->second, is_store);
+        handle_hit(it->second, set_idx, is_store);
     } else {
         // Cache miss
         if (write_allocate || !is_store) {
             // when encountering write-allocate or load miss, load block into cache
-            handle_miss(set, tag, is_store);
+            handle_miss(set, set_idx, tag, is_store);
         } else { //write directly to memory without caching
             stats.store_misses++;
             stats.total_cycles += 100;
@@ -136,13 +280,86 @@ void Cache::access(uint32_t address, bool is_store) {
     }
 }
 
+// Process an access in skewed-associative mode. Way w of the block can
+// only live in set skew_hash(block, w), so a lookup probes one block per
+// way and the replacement candidates are exactly those probed blocks.
+void Cache::access_skewed(uint32_t address, bool is_store) {
+    if (is_store) {
+        stats.total_stores++;
+    } else {
+        stats.total_loads++;
+    }
+    uint32_t tag = get_tag(address);
+
+    // Hash every way up front, then probe
+    for (uint32_t w = 0; w < num_ways; w++)
+        way_sets[w] = skew_hash(tag, w);
+
+    for (uint32_t w = 0; w < num_ways; w++) {
+        Block& block = sets[way_sets[w]].blocks[w];
+        if (block.valid && block.tag == tag) {
+            set_stats[way_sets[w]].accesses++;
+            handle_hit(&block, way_sets[w], is_store);
+            return;
+        }
+    }
+    if (!write_allocate && is_store) {
+        set_stats[way_sets[0]].accesses++;
+        stats.store_misses++;
+        stats.total_cycles += 100;
+        return;
+    }
+
+    // Pick an invalid candidate if any, otherwise the oldest per policy
+    uint32_t victim_way = 0;
+    for (uint32_t w = 0; w < num_ways; w++) {
+        const Block& block = sets[way_sets[w]].blocks[w];
+        if (!block.valid) {
+            victim_way = w;
+            break;
+        }
+        if (block.age < sets[way_sets[victim_way]].blocks[victim_way].age)
+            victim_way = w;
+    }
+    set_stats[way_sets[victim_way]].accesses++;
+    fill_block(&sets[way_sets[victim_way]].blocks[victim_way], way_sets[victim_way], tag, is_store);
+}
+
 // Print cache statistics
-void Cache::print_stats() const {
-    std::cout << "Total loads: " << stats.total_loads << "\n";
-    std::cout << "Total stores: " << stats.total_stores << "\n";
-    std::cout << "Load hits: " << stats.load_hits << "\n";
-    std::cout << "Load misses: " << stats.load_misses << "\n";
-    std::cout << "Store hits: " << stats.store_hits << "\n";
-    std::cout << "Store misses: " << stats.store_misses << "\n";
-    std::cout << "Total cycles: " << stats.total_cycles << "\n";
-}
\ No newline at end of file
+void Cache::print_stats(std::ostream& out) const {
+    out << "Total loads: " << stats.total_loads << "\n";
+    out << "Total stores: " << stats.total_stores << "\n";
+    out << "Load hits: " << stats.load_hits << "\n";
+    out << "Load misses: " << stats.load_misses << "\n";
+    out << "Store hits: " << stats.store_hits << "\n";
+    out << "Store misses: " << stats.store_misses << "\n";
+    out << "Total cycles: " << stats.total_cycles << "\n";
+}
+
+// Print per-set conflict statistics
+void Cache::print_set_stats(std::ostream& out) const {
+    uint64_t sets_used = 0, total_misses = 0, total_evictions = 0;
+    uint64_t max_accesses = 0, max_misses = 0, max_evictions = 0;
+    for (const SetStats& s : set_stats) {
+        sets_used += (s.accesses > 0);
+        total_misses += s.misses;
+        total_evictions += s.evictions;
+        max_accesses = std::max(max_accesses, s.accesses);
+        max_misses = std::max(max_misses, s.misses);
+        max_evictions = std::max(max_evictions, s.evictions);
+    }
+    // only the first prime_sets sets can be indexed in prime mode
+    uint32_t usable_sets = index_mode == IndexMode::PRIME ? prime_sets : num_sets;
+    double mean_misses = static_cast<double>(total_misses) / usable_sets;
+
+    out << "Index mode: " << index_mode_name(index_mode) << "\n";
+    if (index_mode == IndexMode::PRIME)
+        out << "Usable sets: " << prime_sets << "\n";
+    out << "Sets used: " << sets_used << "\n";
+    out << "Max accesses per set: " << max_accesses << "\n";
+    out << "Max misses per set: " << max_misses << "\n";
+    out << "Conflict evictions: " << total_evictions << "\n";
+    out << "Max evictions per set: " << max_evictions << "\n";
+    out << "Miss imbalance (max/mean): " << std::fixed << std::setprecision(2)
+        << (mean_misses > 0 ? max_misses / mean_misses : 0.0) << "\n";
+}
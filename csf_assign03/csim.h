@@ -5,12 +5,20 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <iostream>
+#include "trace.h"
+
+// Replacement order is kept as ages handed out by a per-set clock
+// (load order for FIFO, access order for LRU). When a clock is about
+// to wrap, the ages in its set are renumbered 1..n, so the order
+// survives any number of accesses.
+typedef uint32_t age_t;
 
 // Cache Structures
 struct Block {
     uint32_t tag;
+    age_t age;          // larger is newer within the set's clock domain
     bool valid, dirty;
-    uint32_t load_ts, access_ts;
     
     Block();
 };
@@ -18,10 +26,29 @@ struct Block {
 struct Set {
     std::vector<Block> blocks;  // fixed size: num_blocks_per_set
     std::map<uint32_t, Block*> index; // tag to Block pointer for quick lookup
+    age_t clock;                // last age handed out in this set
     
     Set(uint32_t num_blocks);
 };
 
+// How an address is mapped to a set
+enum class IndexMode {
+    BITS,   // plain bit slicing of the index field
+    XOR,    // block address XOR-folded down to index_bits
+    PRIME,  // block address modulo the largest prime <= num_sets
+    SKEW    // skewed-associative: each way uses its own hash
+};
+
+// Parse "bits", "xor", "prime" or "skew"; returns false if unknown
+bool parse_index_mode(const std::string& name, IndexMode& mode);
+
+// Per-set counters used to report how evenly accesses spread over sets
+struct SetStats {
+    uint64_t accesses = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;     // misses that replaced a valid block
+};
+
 struct Stats {
     uint64_t total_loads = 0;
     uint64_t total_stores = 0;
@@ -35,44 +62,85 @@ struct Stats {
 class Cache {
 private:
     uint32_t num_sets;
+    uint32_t num_ways;
     uint32_t block_size;
-    std::string eviction_policy;    // FIFO or LRU
+    bool lru;                       // LRU if true, FIFO otherwise
     bool write_allocate;
     bool write_through;
     
     std::vector<Set> sets;
     Stats stats;
-    uint32_t timestamp;
     
     uint32_t offset_bits;
     uint32_t index_bits;
     uint32_t tag_bits;
-    
+
+    IndexMode index_mode;
+    uint32_t index_mask;
+    uint32_t tag_shift;         // hashed modes keep the whole block address as tag
+    uint32_t prime_sets;        // modulus for PRIME indexing
+    std::vector<uint32_t> way_multipliers;  // per-way hash constants for SKEW
+    std::vector<uint32_t> way_sets;         // scratch: set probed in each way
+    std::vector<SetStats> set_stats;
+
     // Extract set index from address
     uint32_t get_set_index(uint32_t address) const;
     // Extract tag from address
     uint32_t get_tag(uint32_t address) const;
 
+    // Branch-free set index hashes of a block address
+    uint32_t xor_fold(uint32_t block_addr) const;
+    uint32_t skew_hash(uint32_t block_addr, uint32_t way) const;
+
+    // Compute the set indices of a batch of accesses
+    void get_set_indices(const MemAccess* accesses, uint32_t* indices, size_t n) const;
+
+    // Process an access whose set index has already been computed
+    void access_indexed(uint32_t address, uint32_t set_idx, bool is_store);
+
+    // Process an access in skewed-associative mode
+    void access_skewed(uint32_t address, bool is_store);
+
+    // Next age in the clock domain of a set; a skewed cache compares
+    // blocks across sets, so the whole cache shares set 0's clock
+    age_t next_age(uint32_t set_idx);
+
+    // Renumber the ages in a clock domain to 1..n, preserving order
+    void renumber_ages(uint32_t domain);
+
     // Find victim block for eviction through sequential search
     // Should be called only on misses
     Block* find_victim(Set& set);
 
     // Handle cache miss - load block into cache
-    void handle_miss(Set& set, uint32_t tag, bool is_store);
+    void handle_miss(Set& set, uint32_t set_idx, uint32_t tag, bool is_store);
+
+    // Load a new block over victim, writing back the old one if needed
+    void fill_block(Block* victim, uint32_t set_idx, uint32_t tag, bool is_store);
 
     // Handle cache hit
-    void handle_hit(Block* block, bool is_store);
+    void handle_hit(Block* block, uint32_t set_idx, bool is_store);
 
 public:
     //Initialize Cache
     Cache(uint32_t sets, uint32_t blocks, uint32_t bytes, 
-        const std::string& policy, bool write_alloc, bool write_thru);
+        const std::string& policy, bool write_alloc, bool write_thru,
+        IndexMode mode = IndexMode::BITS);
     
     // Process a memory access
     void access(uint32_t address, bool is_store);
 
+    // Process a batch of memory accesses, hashing all set indices up front
+    void access_batch(const MemAccess* accesses, size_t n);
+
+    // Get cache statistics
+    const Stats& get_stats() const { return stats; }
+
     // Print cache statistics
-    void print_stats() const;
+    void print_stats(std::ostream& out = std::cout) const;
+
+    // Print per-set conflict statistics
+    void print_set_stats(std::ostream& out = std::cout) const;
 };
 
 #endif // CSIM_H
\ No newline at end of file
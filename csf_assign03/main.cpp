@@ -1,9 +1,15 @@
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
 #include "csim.h"
+#include "trace.h"
+#include "profiler.h"
+#include "tlb.h"
+
+// Number of trace lines buffered before they are simulated
+static const size_t TRACE_BATCH = 4096;
 
 void print_usage(const char* prog_name) {
     std::cerr << "Usage: " << prog_name << " <sets> <blocks> <bytes> <allocate> <write> <evict> <trace>\n";
@@ -13,6 +19,11 @@ void print_usage(const char* prog_name) {
     std::cerr << "  <allocate> : write-allocate or no-write-allocate\n";
     std::cerr << "  <write>    : write-through or write-back\n";
     std::cerr << "  <evict>    : lru or fifo\n";
+    std::cerr << "  [index]    : optional bits, xor, prime or skew; also prints per-set conflict stats\n";
+    std::cerr << "  [tlb=<pg>] : optional TLB and page walk model with 4k or 2m pages\n";
+    std::cerr << "   or: " << prog_name << " profile <bytes> <window>\n";
+    std::cerr << "  <bytes>    : Block size used for footprint and reuse distance (power of 2, >= 4)\n";
+    std::cerr << "  <window>   : Number of accesses per working-set window\n";
 }
 
 bool is_power_of_2(uint32_t n) {
@@ -54,9 +65,46 @@ bool validate_parameters(uint32_t sets, uint32_t blocks, uint32_t bytes,
     return true;
 }
 
+// Characterize the trace on stdin instead of simulating a cache
+int run_profile(int argc, char* argv[]) {
+    if (argc != 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    uint32_t block_size = std::atoi(argv[2]);
+    uint64_t window = std::strtoull(argv[3], nullptr, 10);
+    if (!is_power_of_2(block_size) || block_size < 4) {
+        std::cerr << "Error: Block size must be a power of 2 and at least 4\n";
+        return 1;
+    }
+    if (window == 0) {
+        std::cerr << "Error: Window must be a positive number of accesses\n";
+        return 1;
+    }
+
+    Profiler profiler(block_size, window);
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.empty()) continue;
+
+        MemAccess access;
+        if (!parse_trace_line(line, access)) {
+            std::cerr << "Warning: Malformed trace line: " << line << "\n";
+            continue;
+        }
+        profiler.access(access);
+    }
+
+    profiler.print_report();
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 7) {
-        std::cerr << "Usage: " << argv[0] << " <sets> <blocks_per_set> <block_size> <write-allocate|no-write-allocate> <write-through|write-back> <lru|fifo>" << std::endl;
+    if (argc >= 2 && std::string(argv[1]) == "profile")
+        return run_profile(argc, argv);
+
+    if (argc < 7 || argc > 9) {
+        std::cerr << "Usage: " << argv[0] << " <sets> <blocks_per_set> <block_size> <write-allocate|no-write-allocate> <write-through|write-back> <lru|fifo> [bits|xor|prime|skew] [tlb=4k|tlb=2m]" << std::endl;
         return 1;
     }
 
@@ -67,6 +115,24 @@ int main(int argc, char* argv[]) {
     std::string allocate_policy = argv[4];
     std::string write_policy = argv[5];
     std::string eviction_policy = argv[6];
+    // Optional trailing arguments, in any order
+    IndexMode index_mode = IndexMode::BITS;
+    bool report_sets = false;
+    uint32_t page_size = 0;
+    for (int i = 7; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 4, "tlb=") == 0) {
+            if (!parse_page_size(arg.substr(4), page_size)) {
+                std::cerr << "Error: TLB page size must be '4k' or '2m'\n";
+                return 1;
+            }
+        } else if (parse_index_mode(arg, index_mode)) {
+            report_sets = true;
+        } else {
+            std::cerr << "Error: Index mode must be 'bits', 'xor', 'prime' or 'skew'\n";
+            return 1;
+        }
+    }
     
     // Validate parameters
     if (!validate_parameters(num_sets, num_blocks_per_set, block_size,
@@ -80,35 +146,49 @@ int main(int argc, char* argv[]) {
 
     // Create cache
     Cache cache(num_sets, num_blocks_per_set, block_size,
-                eviction_policy, write_allocate, write_through);
+                eviction_policy, write_allocate, write_through, index_mode);
 
-    // Process trace file
+    // Optional address translation in front of the cache
+    std::unique_ptr<TlbHierarchy> tlb;
+    if (page_size != 0)
+        tlb.reset(new TlbHierarchy(page_size));
+
+    // Process trace file in batches so set indices are hashed together
+    std::vector<MemAccess> batch;
+    batch.reserve(TRACE_BATCH);
     std::string line;
     while (std::getline(std::cin, line)) {
         // Skip empty lines 
         if (line.empty()) continue;
 
-        std::istringstream iss(line);
-        char operation;
-        std::string address_str;
-        uint32_t ignore;
-
         // Parse line
-        if (!(iss >> operation >> address_str >> ignore)) {
+        MemAccess access;
+        if (!parse_trace_line(line, access)) {
             std::cerr << "Warning: Malformed trace line: " << line << "\n";
             continue;
         }
 
-        // Convert hex address string to uint32_t
-        uint32_t address = std::stoul(address_str, nullptr, 16);
+        // Page walks must reach the cache before the access they translate,
+        // so translated accesses are simulated one at a time
+        if (tlb) {
+            cache.access(tlb->translate(access.address, cache), access.is_store);
+            continue;
+        }
 
-        // Process the access
-        bool is_store = (operation == 's' || operation == 'S');
-        cache.access(address, is_store);
+        batch.push_back(access);
+        if (batch.size() == TRACE_BATCH) {
+            cache.access_batch(batch.data(), batch.size());
+            batch.clear();
+        }
     }
+    cache.access_batch(batch.data(), batch.size());
 
     // Print statistics
     cache.print_stats();
+    if (report_sets)
+        cache.print_set_stats();
+    if (tlb)
+        tlb->print_stats();
 
     return 0;
 }
\ No newline at end of file
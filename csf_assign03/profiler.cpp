@@ -0,0 +1,198 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+static const uint32_t PAGE_BITS = 12;       // 4 KB pages
+static const uint32_t HUGE_PAGE_BITS = 21;  // 2 MB huge pages
+
+// 64-bit mixing function (splitmix64 finalizer)
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// HyperLogLog implementation
+HyperLogLog::HyperLogLog(uint32_t precision)
+    : precision(precision), registers(1u << precision, 0) {}
+
+void HyperLogLog::add_hash(uint64_t hash) {
+    uint32_t idx = hash >> (64 - precision);
+    // Rank of the first set bit in the remaining bits; the sentinel bit
+    // keeps __builtin_clzll well defined
+    uint64_t rest = (hash << precision) | (1ull << (precision - 1));
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    registers[idx] = std::max(registers[idx], rank);
+}
+
+double HyperLogLog::estimate() const {
+    double m = registers.size();
+    double sum = 0.0;
+    uint32_t zeros = 0;
+    for (uint8_t r : registers) {
+        sum += std::ldexp(1.0, -r);
+        zeros += (r == 0);
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double raw = alpha * m * m / sum;
+    // Small-range correction: linear counting is more accurate here
+    if (raw <= 2.5 * m && zeros > 0)
+        return m * std::log(m / zeros);
+    return raw;
+}
+
+void HyperLogLog::clear() {
+    std::fill(registers.begin(), registers.end(), 0);
+}
+
+// ReuseSampler implementation
+ReuseSampler::ReuseSampler(size_t max_tracked)
+    : threshold(HASH_SPACE), max_tracked(max_tracked), now(0),
+      fenwick(4 * max_tracked + 1, 0), histogram(1, 0.0) {}
+
+void ReuseSampler::fenwick_add(uint64_t pos, int delta) {
+    for (; pos < fenwick.size(); pos += pos & (~pos + 1))
+        fenwick[pos] += delta;
+}
+
+uint64_t ReuseSampler::fenwick_sum(uint64_t pos) const {
+    uint64_t sum = 0;
+    for (; pos > 0; pos -= pos & (~pos + 1))
+        sum += fenwick[pos];
+    return sum;
+}
+
+// Renumber the live last-access times 1..n once the time axis is full
+void ReuseSampler::compact() {
+    std::vector<std::pair<uint64_t, uint64_t>> order;   // (last_time, block)
+    order.reserve(tracked.size());
+    for (const auto& kv : tracked)
+        order.emplace_back(kv.second.last_time, kv.first);
+    std::sort(order.begin(), order.end());
+
+    std::fill(fenwick.begin(), fenwick.end(), 0);
+    now = 0;
+    for (const auto& entry : order) {
+        tracked[entry.second].last_time = ++now;
+        fenwick_add(now, 1);
+    }
+}
+
+// Lower the sampling threshold until at most max_tracked blocks remain
+void ReuseSampler::shrink() {
+    while (tracked.size() > max_tracked) {
+        auto largest = std::prev(by_hash.end());
+        threshold = largest->first;
+        // Drop every block at the new threshold
+        while (!by_hash.empty() && std::prev(by_hash.end())->first >= threshold) {
+            auto it = std::prev(by_hash.end());
+            auto t = tracked.find(it->second);
+            fenwick_add(t->second.last_time, -1);
+            tracked.erase(t);
+            by_hash.erase(it);
+        }
+    }
+}
+
+void ReuseSampler::access(uint64_t block, uint64_t hash) {
+    uint32_t h = hash & (HASH_SPACE - 1);
+    if (h >= threshold)
+        return;
+
+    // Each sampled reference stands for 1 / rate references
+    double weight = 1.0 / sampling_rate();
+    if (now + 1 >= fenwick.size())
+        compact();
+    now++;
+
+    auto it = tracked.find(block);
+    if (it == tracked.end()) {
+        histogram[0] += weight;
+        tracked[block] = Tracked{now, h};
+        by_hash.emplace(h, block);
+        fenwick_add(now, 1);
+        shrink();
+        return;
+    }
+
+    // Distinct sampled blocks touched since the previous access, scaled up
+    uint64_t prev = it->second.last_time;
+    uint64_t distinct = fenwick_sum(now - 1) - fenwick_sum(prev);
+    uint64_t distance = static_cast<uint64_t>(distinct * weight);
+    size_t bucket = 1;
+    while ((2ull << (bucket - 1)) - 1 <= distance)
+        bucket++;
+    if (histogram.size() <= bucket)
+        histogram.resize(bucket + 1, 0.0);
+    histogram[bucket] += weight;
+
+    fenwick_add(prev, -1);
+    fenwick_add(now, 1);
+    it->second.last_time = now;
+}
+
+double ReuseSampler::sampling_rate() const {
+    return static_cast<double>(threshold) / HASH_SPACE;
+}
+
+// Profiler implementation
+Profiler::Profiler(uint32_t block_size, uint64_t window)
+    : offset_bits(log2(block_size)), window_size(window), total_accesses(0) {}
+
+void Profiler::end_window() {
+    windows.emplace_back(window_blocks.estimate(), window_pages.estimate());
+    window_blocks.clear();
+    window_pages.clear();
+}
+
+void Profiler::access(const MemAccess& access) {
+    uint64_t block = access.address >> offset_bits;
+    uint64_t page = access.address >> PAGE_BITS;
+    uint64_t huge_page = access.address >> HUGE_PAGE_BITS;
+
+    uint64_t block_hash = mix64(block);
+    uint64_t page_hash = mix64(page | (1ull << 40));
+
+    block_footprint.add_hash(block_hash);
+    page_footprint.add_hash(page_hash);
+    huge_page_footprint.add_hash(mix64(huge_page | (2ull << 40)));
+    window_blocks.add_hash(block_hash);
+    window_pages.add_hash(page_hash);
+    reuse.access(block, block_hash);
+
+    if (++total_accesses % window_size == 0)
+        end_window();
+}
+
+void Profiler::print_report(std::ostream& out) {
+    if (total_accesses % window_size != 0)
+        end_window();
+
+    uint64_t block_size = 1ull << offset_bits;
+    out << std::fixed << std::setprecision(0);
+    out << "Total accesses: " << total_accesses << "\n";
+    out << "Footprint (" << block_size << "-byte blocks): " << block_footprint.estimate()
+        << " (" << block_footprint.estimate() * block_size << " bytes)\n";
+    out << "Footprint (4 KB pages): " << page_footprint.estimate() << "\n";
+    out << "Footprint (2 MB huge pages): " << huge_page_footprint.estimate() << "\n";
+
+    out << "Reuse distance sampling rate: " << std::setprecision(6)
+        << reuse.sampling_rate() << std::setprecision(0) << "\n";
+    out << "Reuse distance histogram (distinct blocks between reuses):\n";
+    out << "  cold: " << reuse.histogram[0] << "\n";
+    for (size_t i = 1; i < reuse.histogram.size(); i++) {
+        uint64_t lo = (1ull << (i - 1)) - 1, hi = (1ull << i) - 2;
+        out << "  " << lo;
+        if (hi > lo) out << "-" << hi;
+        out << ": " << reuse.histogram[i] << "\n";
+    }
+
+    out << "Working set per window of " << window_size << " accesses:\n";
+    out << "  window blocks pages\n";
+    for (size_t i = 0; i < windows.size(); i++)
+        out << "  " << i << " " << windows[i].first << " " << windows[i].second << "\n";
+}
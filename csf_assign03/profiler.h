@@ -0,0 +1,96 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "trace.h"
+
+// HyperLogLog cardinality estimator with 2^precision one-byte registers
+class HyperLogLog {
+private:
+    uint32_t precision;
+    std::vector<uint8_t> registers;
+
+public:
+    HyperLogLog(uint32_t precision = 14);
+
+    // Add an already hashed key
+    void add_hash(uint64_t hash);
+
+    // Estimated number of distinct keys added
+    double estimate() const;
+
+    // Forget all keys
+    void clear();
+};
+
+// Sampled reuse-distance tracker (fixed-size SHARDS). Only blocks whose
+// hash falls below a threshold are tracked; when more than max_tracked
+// blocks are live the threshold is lowered and the largest hashes are
+// dropped, so memory stays bounded regardless of trace length.
+class ReuseSampler {
+private:
+    static const uint64_t HASH_SPACE = 1ull << 24;
+
+    struct Tracked {
+        uint64_t last_time;
+        uint32_t hash;
+    };
+
+    uint64_t threshold;
+    size_t max_tracked;
+    uint64_t now;
+    std::unordered_map<uint64_t, Tracked> tracked;
+    std::set<std::pair<uint32_t, uint64_t>> by_hash;    // eviction order
+    std::vector<uint32_t> fenwick;   // 1 at the last access time of each tracked block
+
+    void fenwick_add(uint64_t pos, int delta);
+    uint64_t fenwick_sum(uint64_t pos) const;
+    void compact();
+    void shrink();
+
+public:
+    // histogram[0] counts cold misses, histogram[i] for i > 0 counts
+    // distances in [2^(i-1) - 1, 2^i - 1)
+    std::vector<double> histogram;
+
+    ReuseSampler(size_t max_tracked = 32768);
+
+    void access(uint64_t block, uint64_t hash);
+
+    double sampling_rate() const;
+};
+
+// Workload characterization over a trace in a single streaming pass:
+// footprint at several granularities, working set per window and a
+// reuse-distance histogram
+class Profiler {
+private:
+    uint32_t offset_bits;
+    uint64_t window_size;
+    uint64_t total_accesses;
+
+    HyperLogLog block_footprint, page_footprint, huge_page_footprint;
+    HyperLogLog window_blocks, window_pages;
+    ReuseSampler reuse;
+
+    // (block estimate, page estimate) for each completed window
+    std::vector<std::pair<double, double>> windows;
+
+    void end_window();
+
+public:
+    Profiler(uint32_t block_size, uint64_t window);
+
+    // Profile one memory access
+    void access(const MemAccess& access);
+
+    // Print the profile; call once after the whole trace was seen
+    void print_report(std::ostream& out = std::cout);
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,116 @@
+#include "tlb.h"
+#include <algorithm>
+#include <cmath>
+
+// Page table entries are 8 bytes and each table level translates 9 bits
+static const uint32_t PTE_SIZE = 8;
+static const uint32_t LEVEL_BITS = 9;
+
+// Page tables occupy the top 16 MB of the 32-bit address space
+static const uint32_t PT_BASE = 0xFF000000u;
+
+// STLB lookup latency charged on every L1 DTLB miss
+static const uint32_t STLB_LATENCY = 7;
+
+// TLB geometry (entries, ways), modeled on a recent x86 core
+static const uint32_t DTLB_4K_ENTRIES = 64, DTLB_4K_WAYS = 4;
+static const uint32_t DTLB_2M_ENTRIES = 32, DTLB_2M_WAYS = 4;
+static const uint32_t STLB_ENTRIES = 1536, STLB_WAYS = 12;
+
+bool parse_page_size(const std::string& name, uint32_t& page_size) {
+    if (name == "4k") page_size = 4096;
+    else if (name == "2m") page_size = 2 * 1024 * 1024;
+    else return false;
+    return true;
+}
+
+// Tlb implementation
+Tlb::Tlb(uint32_t entries, uint32_t ways)
+    : num_sets(entries / ways), num_ways(ways), sets(entries / ways) {}
+
+bool Tlb::lookup(uint32_t vpn) {
+    std::vector<uint32_t>& set = sets[vpn % num_sets];
+    auto it = std::find(set.begin(), set.end(), vpn);
+    if (it == set.end())
+        return false;
+    std::rotate(set.begin(), it, it + 1);
+    return true;
+}
+
+void Tlb::insert(uint32_t vpn) {
+    std::vector<uint32_t>& set = sets[vpn % num_sets];
+    if (set.size() == num_ways)
+        set.pop_back();
+    set.insert(set.begin(), vpn);
+}
+
+// TlbHierarchy implementation
+TlbHierarchy::TlbHierarchy(uint32_t page_size)
+    : page_bits(log2(page_size)),
+      levels(page_size == 4096 ? 4 : 3),
+      l1(page_size == 4096 ? DTLB_4K_ENTRIES : DTLB_2M_ENTRIES,
+         page_size == 4096 ? DTLB_4K_WAYS : DTLB_2M_WAYS),
+      l2(STLB_ENTRIES, STLB_WAYS),
+      next_frame(0), max_frames(PT_BASE >> page_bits) {
+
+    // Lay the levels out leaf first; a level whose entries each cover
+    // 2^shift bytes needs 2^(32 - shift) entries to span 32 bits
+    uint32_t offset = 0;
+    level_base.resize(levels);
+    for (uint32_t level = levels; level-- > 0; ) {
+        level_base[level] = offset;
+        uint32_t shift = page_bits + LEVEL_BITS * (levels - 1 - level);
+        uint64_t entries = shift >= 32 ? 1 : (1ull << (32 - shift));
+        offset += entries * PTE_SIZE;
+    }
+}
+
+// Read every page table entry for vaddr through the cache, root first
+void TlbHierarchy::walk(uint32_t vaddr, Cache& cache) {
+    uint64_t cycles_before = cache.get_stats().total_cycles;
+    for (uint32_t level = 0; level < levels; level++) {
+        uint32_t shift = page_bits + LEVEL_BITS * (levels - 1 - level);
+        uint64_t entry = static_cast<uint64_t>(vaddr) >> shift;
+        cache.access(PT_BASE + level_base[level] + entry * PTE_SIZE, false);
+        stats.walk_accesses++;
+    }
+    stats.walk_cycles += cache.get_stats().total_cycles - cycles_before;
+}
+
+uint32_t TlbHierarchy::translate(uint32_t vaddr, Cache& cache) {
+    uint32_t vpn = vaddr >> page_bits;
+
+    if (l1.lookup(vpn)) {
+        stats.l1_hits++;
+    } else {
+        stats.l1_misses++;
+        stats.l2_cycles += STLB_LATENCY;
+        if (l2.lookup(vpn)) {
+            stats.l2_hits++;
+        } else {
+            stats.l2_misses++;
+            walk(vaddr, cache);
+            l2.insert(vpn);
+        }
+        l1.insert(vpn);
+    }
+
+    // First touch of a page maps it to the next free frame
+    auto it = frames.find(vpn);
+    if (it == frames.end())
+        it = frames.emplace(vpn, next_frame++ % max_frames).first;
+    uint32_t offset_mask = (1u << page_bits) - 1;
+    return (it->second << page_bits) | (vaddr & offset_mask);
+}
+
+void TlbHierarchy::print_stats(std::ostream& out) const {
+    out << "Page size: " << (1u << page_bits) << "\n";
+    out << "DTLB hits: " << stats.l1_hits << "\n";
+    out << "DTLB misses: " << stats.l1_misses << "\n";
+    out << "STLB hits: " << stats.l2_hits << "\n";
+    out << "STLB misses: " << stats.l2_misses << "\n";
+    out << "Page walk accesses: " << stats.walk_accesses << "\n";
+    out << "Page walk cycles: " << stats.walk_cycles << "\n";
+    out << "STLB lookup cycles: " << stats.l2_cycles << "\n";
+    out << "Pages touched: " << frames.size() << "\n";
+}
@@ -0,0 +1,72 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "csim.h"
+
+// One set-associative TLB level with LRU replacement
+class Tlb {
+private:
+    uint32_t num_sets;
+    uint32_t num_ways;
+    // each set holds valid virtual page numbers, most recently used first
+    std::vector<std::vector<uint32_t>> sets;
+
+public:
+    Tlb(uint32_t entries, uint32_t ways);
+
+    // Look up a virtual page number, making it most recently used on a hit
+    bool lookup(uint32_t vpn);
+
+    // Install a translation, evicting the LRU entry of its set if full
+    void insert(uint32_t vpn);
+};
+
+struct TlbStats {
+    uint64_t l1_hits = 0;
+    uint64_t l1_misses = 0;
+    uint64_t l2_hits = 0;
+    uint64_t l2_misses = 0;        // each one is a page walk
+    uint64_t walk_accesses = 0;    // page table entries read during walks
+    uint64_t walk_cycles = 0;      // cache cycles spent on those reads
+    uint64_t l2_cycles = 0;        // STLB lookup latency
+};
+
+// Address translation in front of the cache: an L1 DTLB backed by an
+// L2 STLB and an x86-64 style radix page table. Page table entries live
+// in a reserved region of the address space and are read through the
+// cache on every walk. Physical frames are assigned in first-touch order.
+class TlbHierarchy {
+private:
+    uint32_t page_bits;
+    uint32_t levels;
+    Tlb l1, l2;
+    TlbStats stats;
+
+    std::vector<uint32_t> level_base;   // offset of each level's table region
+    std::unordered_map<uint32_t, uint32_t> frames;  // vpn -> pfn
+    uint32_t next_frame;
+    uint32_t max_frames;
+
+    // Read every page table entry for vaddr through the cache
+    void walk(uint32_t vaddr, Cache& cache);
+
+public:
+    // page_size is 4096 or 2 MB
+    TlbHierarchy(uint32_t page_size);
+
+    // Translate a virtual address, charging TLB misses and walks
+    uint32_t translate(uint32_t vaddr, Cache& cache);
+
+    // Print TLB statistics
+    void print_stats(std::ostream& out = std::cout) const;
+};
+
+// Parse "4k" or "2m" into a page size in bytes; returns false if unknown
+bool parse_page_size(const std::string& name, uint32_t& page_size);
+
+#endif // TLB_H
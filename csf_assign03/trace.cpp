@@ -0,0 +1,37 @@
+#include "trace.h"
+#include <iostream>
+#include <sstream>
+
+// Parse one trace line of the form "<l|s> <hex address> <ignored>"
+bool parse_trace_line(const std::string& line, MemAccess& access) {
+    std::istringstream iss(line);
+    char operation;
+    std::string address_str;
+    uint32_t ignore;
+
+    if (!(iss >> operation >> address_str >> ignore))
+        return false;
+
+    // Convert hex address string to uint32_t
+    access.address = std::stoul(address_str, nullptr, 16);
+    access.is_store = (operation == 's' || operation == 'S');
+    return true;
+}
+
+// Read every access from a trace stream
+std::vector<MemAccess> read_trace(std::istream& in) {
+    std::vector<MemAccess> accesses;
+    std::string line;
+    while (std::getline(in, line)) {
+        // Skip empty lines
+        if (line.empty()) continue;
+
+        MemAccess access;
+        if (!parse_trace_line(line, access)) {
+            std::cerr << "Warning: Malformed trace line: " << line << "\n";
+            continue;
+        }
+        accesses.push_back(access);
+    }
+    return accesses;
+}
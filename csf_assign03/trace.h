@@ -0,0 +1,23 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// A single memory access from a trace file
+struct MemAccess {
+    uint32_t address;
+    bool is_store;
+};
+
+// Parse one trace line of the form "<l|s> <hex address> <ignored>"
+// Returns false if the line is malformed
+bool parse_trace_line(const std::string& line, MemAccess& access);
+
+// Read every access from a trace stream, skipping empty lines
+// and warning about malformed ones
+std::vector<MemAccess> read_trace(std::istream& in);
+
+#endif // TRACE_H
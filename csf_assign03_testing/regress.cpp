@@ -0,0 +1,272 @@
+// Native regression driver for csim
+//
+// Loads every expected result under expected_results/<trace>/, parses each
+// trace only once, and runs all (trace, config) pairs on a pool of threads
+// inside a single process. Mismatches and per-case timing are reported.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "csim.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+// One (trace, config) pair, described by an expected result file named
+// <sets>_<blocks>_<bytes>_<wa|nwa>_<wt|wb>_<lru|fifo>.txt
+struct TestCase {
+    std::string trace_name;
+    uint32_t sets, blocks, bytes;
+    bool write_allocate, write_through;
+    std::string policy;
+    fs::path expected_path;
+    const std::vector<MemAccess>* trace = nullptr;
+
+    std::string label() const;
+};
+
+struct TestResult {
+    bool passed = false;
+    std::vector<std::string> differences;
+    double millis = 0.0;
+};
+
+std::string TestCase::label() const {
+    std::ostringstream ss;
+    ss << "csim " << sets << " " << blocks << " " << bytes << " "
+       << (write_allocate ? "write-allocate" : "no-write-allocate") << " "
+       << (write_through ? "write-through" : "write-back") << " "
+       << policy << " < " << trace_name << ".trace";
+    return ss.str();
+}
+
+void print_usage(const char* prog_name) {
+    std::cerr << "Usage: " << prog_name << " [options] [expected dir] [trace dir]\n";
+    std::cerr << "  -j <n>          : Number of worker threads (default: hardware concurrency)\n";
+    std::cerr << "  --policy <p>    : Only run lru or fifo configurations\n";
+    std::cerr << "  --cycles        : Also require total cycles to be within 5%\n";
+    std::cerr << "  [expected dir]  : defaults to expected_results\n";
+    std::cerr << "  [trace dir]     : defaults to traces\n";
+}
+
+// Split an expected result file name into a test configuration
+bool parse_case_name(const std::string& stem, TestCase& tc) {
+    std::vector<std::string> parts;
+    std::istringstream iss(stem);
+    std::string part;
+    while (std::getline(iss, part, '_'))
+        parts.push_back(part);
+    if (parts.size() != 6)
+        return false;
+
+    char* end;
+    tc.sets = std::strtoul(parts[0].c_str(), &end, 10);
+    if (*end != '\0') return false;
+    tc.blocks = std::strtoul(parts[1].c_str(), &end, 10);
+    if (*end != '\0') return false;
+    tc.bytes = std::strtoul(parts[2].c_str(), &end, 10);
+    if (*end != '\0') return false;
+
+    if (parts[3] != "wa" && parts[3] != "nwa") return false;
+    if (parts[4] != "wt" && parts[4] != "wb") return false;
+    if (parts[5] != "lru" && parts[5] != "fifo") return false;
+    tc.write_allocate = (parts[3] == "wa");
+    tc.write_through = (parts[4] == "wt");
+    tc.policy = parts[5];
+    return true;
+}
+
+// Read "Key: value" lines from csim output into a map
+std::map<std::string, uint64_t> parse_stats(std::istream& in) {
+    std::map<std::string, uint64_t> values;
+    std::string line;
+    while (std::getline(in, line)) {
+        auto colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        values[line.substr(0, colon)] = std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+    }
+    return values;
+}
+
+// Simulate one test case and compare against its expected output
+TestResult run_case(const TestCase& tc, bool check_cycles) {
+    TestResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    Cache cache(tc.sets, tc.blocks, tc.bytes, tc.policy,
+                tc.write_allocate, tc.write_through);
+    cache.access_batch(tc.trace->data(), tc.trace->size());
+
+    std::stringstream actual_out;
+    cache.print_stats(actual_out);
+    auto actual = parse_stats(actual_out);
+
+    std::ifstream expected_in(tc.expected_path);
+    auto expected = parse_stats(expected_in);
+
+    for (const auto& kv : expected) {
+        auto it = actual.find(kv.first);
+        if (it == actual.end()) {
+            result.differences.push_back(kv.first + ": missing from output");
+            continue;
+        }
+        bool ok;
+        if (kv.first == "Total cycles") {
+            // Cycle counts are only checked (within 5%) when asked for
+            ok = !check_cycles || (it->second >= kv.second * 0.95 && it->second <= kv.second * 1.05);
+        } else {
+            ok = (it->second == kv.second);
+        }
+        if (!ok) {
+            result.differences.push_back(kv.first + ": expected " + std::to_string(kv.second)
+                                         + ", actual " + std::to_string(it->second));
+        }
+    }
+    result.passed = result.differences.empty();
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.millis = std::chrono::duration<double, std::milli>(elapsed).count();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string policy_filter;
+    bool check_cycles = false;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            num_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--policy" && i + 1 < argc) {
+            policy_filter = argv[++i];
+            std::transform(policy_filter.begin(), policy_filter.end(), policy_filter.begin(), ::tolower);
+        } else if (arg == "--cycles") {
+            check_cycles = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() > 2 ||
+        (!policy_filter.empty() && policy_filter != "lru" && policy_filter != "fifo")) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    fs::path expected_dir = positional.size() > 0 ? positional[0] : "expected_results";
+    fs::path trace_dir = positional.size() > 1 ? positional[1] : "traces";
+
+    if (!fs::is_directory(expected_dir)) {
+        std::cerr << "Error: Expected results directory does not exist: " << expected_dir << "\n";
+        return 1;
+    }
+
+    // Collect test cases and load each referenced trace exactly once
+    std::vector<TestCase> cases;
+    std::map<std::string, std::unique_ptr<std::vector<MemAccess>>> traces;
+    int skipped = 0;
+
+    for (const auto& trace_entry : fs::directory_iterator(expected_dir)) {
+        if (!trace_entry.is_directory()) continue;
+        std::string trace_name = trace_entry.path().filename().string();
+
+        for (const auto& entry : fs::directory_iterator(trace_entry.path())) {
+            if (entry.path().extension() != ".txt") continue;
+
+            TestCase tc;
+            tc.trace_name = trace_name;
+            tc.expected_path = entry.path();
+            if (!parse_case_name(entry.path().stem().string(), tc)) {
+                std::cerr << "Warning: Skipping unrecognized result file: " << entry.path() << "\n";
+                continue;
+            }
+            if (!policy_filter.empty() && tc.policy != policy_filter) continue;
+
+            auto it = traces.find(trace_name);
+            if (it == traces.end()) {
+                fs::path trace_path = trace_dir / (trace_name + ".trace");
+                std::ifstream in(trace_path);
+                std::unique_ptr<std::vector<MemAccess>> trace;
+                if (in) {
+                    trace.reset(new std::vector<MemAccess>(read_trace(in)));
+                } else {
+                    std::cerr << "ERROR: Missing trace file: " << trace_path << "\n";
+                }
+                it = traces.emplace(trace_name, std::move(trace)).first;
+            }
+            if (!it->second) {
+                skipped++;
+                continue;
+            }
+
+            tc.trace = it->second.get();
+            cases.push_back(tc);
+        }
+    }
+
+    // Sort so that the report is stable regardless of directory order
+    std::sort(cases.begin(), cases.end(), [](const TestCase& a, const TestCase& b) {
+        return a.expected_path < b.expected_path;
+    });
+
+    // Run all cases on the thread pool; workers claim the next case index
+    std::vector<TestResult> results(cases.size());
+    std::atomic<size_t> next_case(0);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_case.fetch_add(1)) < cases.size())
+            results[i] = run_case(cases[i], check_cycles);
+    };
+    std::vector<std::thread> pool;
+    unsigned pool_size = std::min<size_t>(num_threads, std::max<size_t>(cases.size(), 1));
+    for (unsigned t = 0; t < pool_size; t++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double total_millis = std::chrono::duration<double, std::milli>(elapsed).count();
+
+    // Report
+    int passed = 0, failed = 0;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const TestResult& r = results[i];
+        std::cout << (r.passed ? "PASS " : "FAIL ") << std::fixed << std::setprecision(3)
+                  << std::setw(10) << r.millis << " ms  " << cases[i].label() << "\n";
+        for (const auto& diff : r.differences)
+            std::cout << "        " << diff << "\n";
+        (r.passed ? passed : failed)++;
+    }
+
+    std::cout << "==========================================\n";
+    std::cout << "Total Tests Run: " << cases.size() << " (" << pool_size << " threads, "
+              << std::fixed << std::setprecision(3) << total_millis << " ms)\n";
+    std::cout << "Passed: " << passed << "\n";
+    std::cout << "Failed: " << failed << "\n";
+    if (skipped > 0)
+        std::cout << "Skipped (missing trace): " << skipped << "\n";
+
+    if (failed == 0) {
+        std::cout << "All tests passed successfully!\n";
+        return 0;
+    }
+    std::cout << "Some tests failed.\n";
+    return 1;
+}
@@ -0,0 +1,98 @@
+// Automatic par_threshold ("auto" on the command line).
+//
+// The cutoff is derived from three things:
+//  - the leaf sort's speed on this machine and data, measured by sorting
+//    a sample of the input (CALIBRATION_ELEMENTS elements taken evenly
+//    across it) and expressed as nanoseconds per n log2 n;
+//  - the cost of handing a range to another worker (a fork for the fork
+//    engine, a deque push and steal for the thread engine). A leaf must
+//    take at least LEAF_COST_FACTOR times that cost, so the overhead
+//    stays small;
+//  - the number of workers (-t for the thread engine, -p + 1 processes
+//    for the fork engine) and the file size: above that minimum, the
+//    cutoff aims for TASKS_PER_CORE leaves per worker so that idle
+//    workers always find work.
+// With a single worker nothing is gained by splitting, so the cutoff is
+// the whole array.
+//
+// Per subtree, the cutoff adapts to how well the partitions split. The
+// larger side of a split worse than IMBALANCE_RATIO : 1 gets half the
+// cutoff (but never less than the minimum leaf size). That side holds
+// most of the remaining work and will take more levels to break up, so
+// it is split more finely to keep the other workers busy.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "parsort.h"
+
+#define CALIBRATION_ELEMENTS 65536
+#define TASKS_PER_CORE 8
+#define LEAF_COST_FACTOR 100
+#define IMBALANCE_RATIO 4
+
+// Cost of handing a range to another worker, in nanoseconds
+#define FORK_COST_NS 150000.0
+#define STEAL_COST_NS 5000.0
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Nanoseconds per element * log2(elements) of the leaf sort on a sample
+static double calibrate_leaf_sort(const int64_t *arr, unsigned long n) {
+    unsigned long m = n < CALIBRATION_ELEMENTS ? n : CALIBRATION_ELEMENTS;
+    if (m < 2)
+        return 1.0;
+    int64_t *sample = malloc(m * sizeof(int64_t));
+    if (sample == NULL)
+        return 1.0;
+    for (unsigned long i = 0; i < m; i++)
+        sample[i] = arr[i * (n / m)];
+
+    double start = now_ns();
+    sort_int64(sample, m);
+    double elapsed = now_ns() - start;
+    free(sample);
+
+    double per_unit = elapsed / (m * log2((double) m));
+    return per_unit > 0 ? per_unit : 1.0;
+}
+
+unsigned long auto_par_threshold(const int64_t *arr, unsigned long n, const struct Options *opts,
+                                 unsigned long *min_threshold) {
+    unsigned cores = opts->engine == ENGINE_THREADS ? opts->num_threads : (unsigned) opts->max_procs + 1;
+    if (cores < 2 || n < 2) {
+        *min_threshold = 0;
+        return n;
+    }
+
+    // smallest leaf whose sort time is LEAF_COST_FACTOR times the
+    // cost of handing it to another worker
+    double per_unit = calibrate_leaf_sort(arr, n);
+    double handoff = opts->engine == ENGINE_THREADS ? STEAL_COST_NS : FORK_COST_NS;
+    unsigned long leaf_min = 1024;
+    while (leaf_min < n && per_unit * leaf_min * log2((double) leaf_min) < LEAF_COST_FACTOR * handoff)
+        leaf_min *= 2;
+
+    unsigned long balanced = n / ((unsigned long) cores * TASKS_PER_CORE);
+    unsigned long threshold = balanced > leaf_min ? balanced : leaf_min;
+    *min_threshold = leaf_min;
+
+    if (opts->verbose)
+        fprintf(stderr, "auto threshold: %lu (leaf sort %.2f ns per n log n, minimum leaf %lu, %u workers)\n",
+                threshold, per_unit, leaf_min, cores);
+    return threshold;
+}
+
+unsigned long adapt_threshold(unsigned long threshold, unsigned long min_threshold,
+                              unsigned long side, unsigned long other) {
+    if (min_threshold == 0 || side <= other * IMBALANCE_RATIO)
+        return threshold;
+    unsigned long halved = threshold / 2;
+    return halved > min_threshold ? halved : min_threshold;
+}
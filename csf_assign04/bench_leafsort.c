@@ -0,0 +1,94 @@
+// Benchmark of the sequential leaf sort: libc qsort vs sort_int64 with
+// and without the AVX2 small-block network, over a range of sizes.
+// Every result is checked against the qsort output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "parsort.h"
+
+// Total number of elements sorted per (size, method) measurement
+#define WORK_PER_SIZE (1UL << 23)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_int64(const void *left, const void *right) {
+    int64_t l = *(const int64_t *) left, r = *(const int64_t *) right;
+    return (l > r) - (l < r);
+}
+
+static void sort_qsort(int64_t *arr, unsigned long n) {
+    qsort(arr, n, sizeof(int64_t), compare_int64);
+}
+
+static void sort_leaf(int64_t *arr, unsigned long n) {
+    sort_int64(arr, n);
+}
+
+// Time sorting reps consecutive n-element slices of input; returns ns
+// per element, or -1 if the first result differs from expected
+static double run(void (*sort_fn)(int64_t *, unsigned long), const int64_t *input,
+                  const int64_t *expected, int64_t *work, unsigned long n, unsigned long reps) {
+    memcpy(work, input, n * reps * sizeof(int64_t));
+    double start = now_sec();
+    for (unsigned long r = 0; r < reps; r++)
+        sort_fn(work + r * n, n);
+    double total = now_sec() - start;
+    if (memcmp(work, expected, n * sizeof(int64_t)) != 0)
+        return -1.0;
+    return total * 1e9 / (double) (n * reps);
+}
+
+int main(void) {
+    static const unsigned long sizes[] = { 8, 16, 32, 64, 256, 1024, 4096, 65536, 1UL << 20 };
+    int simd = sort_int64_simd_available();
+
+    printf("%10s %12s %12s %12s %10s\n", "size", "qsort ns/el", "scalar", simd ? "avx2" : "(no avx2)", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned long n = sizes[s];
+        unsigned long reps = WORK_PER_SIZE / n;
+        int64_t *input = malloc(n * reps * sizeof(int64_t));
+        int64_t *expected = malloc(n * sizeof(int64_t));
+        int64_t *work = malloc(n * reps * sizeof(int64_t));
+        if (input == NULL || expected == NULL || work == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            return 1;
+        }
+        for (unsigned long i = 0; i < n * reps; i++)
+            input[i] = (int64_t) xorshift64();
+        memcpy(expected, input, n * sizeof(int64_t));
+        sort_qsort(expected, n);
+
+        double t_qsort = run(sort_qsort, input, expected, work, n, reps);
+        sort_int64_use_simd(0);
+        double t_scalar = run(sort_leaf, input, expected, work, n, reps);
+        sort_int64_use_simd(1);
+        double t_simd = simd ? run(sort_leaf, input, expected, work, n, reps) : t_scalar;
+        if (t_scalar < 0 || t_simd < 0) {
+            fprintf(stderr, "Error: sort_int64 result differs from qsort at size %lu\n", n);
+            return 1;
+        }
+        double best = t_simd < t_scalar ? t_simd : t_scalar;
+        printf("%10lu %12.2f %12.2f %12.2f %9.2fx\n", n, t_qsort, t_scalar, t_simd, t_qsort / best);
+
+        free(input);
+        free(expected);
+        free(work);
+    }
+    return 0;
+}
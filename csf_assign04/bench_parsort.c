@@ -0,0 +1,231 @@
+// Scaling benchmark for parsort.
+//
+// For every distribution, inputs are generated once from a fixed seed
+// by gen_pattern_data. Each run sorts a fresh copy of the input with
+// ./parsort, and the run is measured with wait4, so it includes fork
+// engine children that parsort waited for. Two tables are printed:
+//   strong scaling: fixed input size, increasing thread counts
+//   weak scaling:   size per thread fixed, total size grows with threads
+// Each row reports wall time, user+system CPU time, minor and major page
+// faults, and max RSS. It also reports speedup (strong) or efficiency
+// (weak) relative to the 1-thread run of the same configuration.
+//
+// Usage: bench_parsort [options]
+//   -s SIZE      input size in bytes per run, M suffix allowed (default: 32M)
+//   -d LIST      distributions (default: uniform,gaussian,zipf,runs,duplicates)
+//   -e LIST      engines (default: fork,threads)
+//   -p LIST      par_threshold values (default: 65536,1048576)
+//   -j LIST      thread counts (default: 1,2,4)
+//   -r SEED      generator seed (default: 1)
+//   -D DIR       directory for input files (default: /tmp)
+// For the fork engine, N threads means -t N -p N-1 (N processes).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define MAX_LIST 32
+
+typedef struct {
+    double wall, cpu;
+    long minflt, majflt, maxrss_kb;
+    int ok;
+} Result;
+
+// Split a comma-separated list in place; returns the number of items
+static int split_list(char *str, char **items) {
+    int n = 0;
+    for (char *save, *tok = strtok_r(str, ",", &save); tok != NULL && n < MAX_LIST;
+         tok = strtok_r(NULL, ",", &save))
+        items[n++] = tok;
+    return n;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Run argv to completion and return its resource usage
+static Result run(char **argv) {
+    Result r = { 0 };
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return r;
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return r;
+    }
+    r.wall = now() - start;
+    r.cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+          + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+    r.minflt = ru.ru_minflt;
+    r.majflt = ru.ru_majflt;
+    r.maxrss_kb = ru.ru_maxrss;
+    r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return r;
+}
+
+static int copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+    if (in == NULL || out == NULL) {
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return 0;
+    }
+    static char buf[1 << 20];
+    size_t n;
+    int ok = 1;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        ok &= fwrite(buf, 1, n, out) == n;
+    fclose(in);
+    ok &= fclose(out) == 0;
+    return ok;
+}
+
+// Generate <dir>/bench_<dist>_<size>_<seed>.in unless it exists already
+static int generate(const char *dir, const char *dist, unsigned long size,
+                    const char *seed, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/bench_%s_%lu_%s.in", dir, dist, size, seed);
+    if (access(path, R_OK) == 0)
+        return 1;
+    char size_str[32];
+    snprintf(size_str, sizeof(size_str), "%lu", size);
+    char *argv[] = { "./gen_pattern_data", (char *) dist, size_str, path, (char *) seed, NULL };
+    return run(argv).ok;
+}
+
+// Sort a copy of input with one configuration
+static Result bench_one(const char *input, const char *dir, const char *engine,
+                        const char *threshold, int threads) {
+    char work[4096], t_opt[32], p_opt[32];
+    snprintf(work, sizeof(work), "%s/bench_work.in", dir);
+    Result r = { 0 };
+    if (!copy_file(input, work)) {
+        fprintf(stderr, "Error: can't copy '%s' to '%s'\n", input, work);
+        return r;
+    }
+    snprintf(t_opt, sizeof(t_opt), "-t%d", threads);
+    snprintf(p_opt, sizeof(p_opt), "-p%d", threads - 1);
+    char e_opt[64];
+    snprintf(e_opt, sizeof(e_opt), "--engine=%s", engine);
+    char *argv[] = { "./parsort", e_opt, t_opt, p_opt, work, (char *) threshold, NULL };
+    r = run(argv);
+    unlink(work);
+    return r;
+}
+
+static void print_header(const char *kind, const char *relative) {
+    printf("\n%s scaling\n", kind);
+    printf("%-11s %-8s %10s %10s %7s %9s %9s %9s %8s %11s %9s\n",
+           "dist", "engine", "bytes", "threshold", "threads", "wall_s", "cpu_s",
+           "minflt", "majflt", "maxrss_kb", relative);
+}
+
+static void print_row(const char *dist, const char *engine, unsigned long size,
+                      const char *threshold, int threads, Result r, double relative) {
+    if (!r.ok) {
+        printf("%-11s %-8s %10lu %10s %7d %9s\n", dist, engine, size, threshold, threads, "FAILED");
+        return;
+    }
+    printf("%-11s %-8s %10lu %10s %7d %9.3f %9.3f %9ld %8ld %11ld %9.2f\n",
+           dist, engine, size, threshold, threads, r.wall, r.cpu,
+           r.minflt, r.majflt, r.maxrss_kb, relative);
+    fflush(stdout);
+}
+
+static unsigned long parse_size(const char *str) {
+    char *end;
+    unsigned long size = strtoul(str, &end, 10);
+    if (*end == 'M')
+        size *= 1024UL * 1024UL;
+    return size;
+}
+
+int main(int argc, char **argv) {
+    unsigned long size = 32UL << 20;
+    char dists_buf[256] = "uniform,gaussian,zipf,runs,duplicates";
+    char engines_buf[256] = "fork,threads";
+    char thresholds_buf[256] = "65536,1048576";
+    char threads_buf[256] = "1,2,4";
+    const char *seed = "1", *dir = "/tmp";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:d:e:p:j:r:D:")) != -1) {
+        switch (opt) {
+        case 's': size = parse_size(optarg); break;
+        case 'd': snprintf(dists_buf, sizeof(dists_buf), "%s", optarg); break;
+        case 'e': snprintf(engines_buf, sizeof(engines_buf), "%s", optarg); break;
+        case 'p': snprintf(thresholds_buf, sizeof(thresholds_buf), "%s", optarg); break;
+        case 'j': snprintf(threads_buf, sizeof(threads_buf), "%s", optarg); break;
+        case 'r': seed = optarg; break;
+        case 'D': dir = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-s size] [-d dists] [-e engines] [-p thresholds] "
+                            "[-j threads] [-r seed] [-D dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char *dists[MAX_LIST], *engines[MAX_LIST], *thresholds[MAX_LIST], *thread_strs[MAX_LIST];
+    int num_dists = split_list(dists_buf, dists);
+    int num_engines = split_list(engines_buf, engines);
+    int num_thresholds = split_list(thresholds_buf, thresholds);
+    int num_threads = split_list(threads_buf, thread_strs);
+    int threads[MAX_LIST];
+    for (int i = 0; i < num_threads; i++)
+        threads[i] = atoi(thread_strs[i]) > 0 ? atoi(thread_strs[i]) : 1;
+
+    int failures = 0;
+    char path[4096];
+    for (int weak = 0; weak <= 1; weak++) {
+        print_header(weak ? "Weak" : "Strong", weak ? "efficiency" : "speedup");
+        for (int d = 0; d < num_dists; d++) {
+            for (int e = 0; e < num_engines; e++) {
+                for (int p = 0; p < num_thresholds; p++) {
+                    double base = 0;
+                    for (int j = 0; j < num_threads; j++) {
+                        unsigned long run_size = weak ? size * threads[j] : size;
+                        if (!generate(dir, dists[d], run_size, seed, path, sizeof(path))) {
+                            fprintf(stderr, "Error: can't generate %s input\n", dists[d]);
+                            return 1;
+                        }
+                        Result r = bench_one(path, dir, engines[e], thresholds[p], threads[j]);
+                        failures += !r.ok;
+                        // relative to the first (normally 1-thread) run; for weak
+                        // scaling, ideal efficiency is 1.0
+                        if (j == 0)
+                            base = r.wall * (weak ? 1 : threads[0]);
+                        double relative = r.ok && r.wall > 0 ? base / r.wall : 0;
+                        print_row(dists[d], engines[e], run_size, thresholds[p], threads[j], r, relative);
+                    }
+                }
+            }
+            for (int j = 0; j < num_threads; j++) {
+                unsigned long run_size = weak ? size * threads[j] : size;
+                snprintf(path, sizeof(path), "%s/bench_%s_%lu_%s.in", dir, dists[d], run_size, seed);
+                unlink(path);
+            }
+        }
+    }
+    return failures > 0;
+}
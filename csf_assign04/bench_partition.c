@@ -0,0 +1,173 @@
+// Check and benchmark of the two-way partition kernels (partkernel.c).
+//
+// Every available kernel is run on many inputs (edge-case sizes, random
+// keys, few unique keys, sorted and reversed runs, extreme values) with
+// several pivots and both predicates, and checked against the scalar
+// reference: the same number of elements must go first, the predicate
+// must hold on the left side and fail on the right, and the result must
+// be a permutation of the input. Then each kernel is timed on random
+// inputs that fit in the cache.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "parsort.h"
+
+// Elements partitioned per timing measurement, and measurements
+#define BENCH_SIZE (1UL << 16)
+#define BENCH_REPS 500
+
+#define NUM_KERNELS 4
+
+enum Pattern { RANDOM, FEW_UNIQUE, SORTED, REVERSED, EXTREMES, NUM_PATTERNS };
+
+static const char *pattern_names[NUM_PATTERNS] = { "random", "few-unique", "sorted", "reversed", "extremes" };
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t xorshift64(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_int64(const void *left, const void *right) {
+    int64_t l = *(const int64_t *) left, r = *(const int64_t *) right;
+    return (l > r) - (l < r);
+}
+
+static void fill(int64_t *arr, unsigned long n, enum Pattern pattern) {
+    static const int64_t extremes[] = { INT64_MIN, INT64_MIN + 1, -1, 0, 1, INT64_MAX - 1, INT64_MAX };
+    for (unsigned long i = 0; i < n; i++) {
+        switch (pattern) {
+        case RANDOM: arr[i] = (int64_t) xorshift64(); break;
+        case FEW_UNIQUE: arr[i] = (int64_t) (xorshift64() % 5) - 2; break;
+        case SORTED: arr[i] = (int64_t) i; break;
+        case REVERSED: arr[i] = (int64_t) (n - i); break;
+        default: arr[i] = extremes[xorshift64() % 7]; break;
+        }
+    }
+}
+
+static int goes_first(int64_t x, int64_t pivot, int equal_left) {
+    return equal_left ? x <= pivot : x < pivot;
+}
+
+// Check kernel on input against the scalar reference; returns 0 and
+// prints the case if it fails
+static int check(enum PartitionKernel kernel, const int64_t *input, unsigned long n,
+                 int64_t pivot, int equal_left, enum Pattern pattern,
+                 int64_t *expected, int64_t *work) {
+    memcpy(expected, input, n * sizeof(int64_t));
+    partition_kernel_use(PARTITION_SCALAR);
+    unsigned long expected_split = partition_split(expected, n, pivot, equal_left);
+    memcpy(work, input, n * sizeof(int64_t));
+    partition_kernel_use(kernel);
+    unsigned long split = partition_split(work, n, pivot, equal_left);
+
+    const char *problem = NULL;
+    if (split != expected_split)
+        problem = "wrong split";
+    for (unsigned long i = 0; i < n && problem == NULL; i++)
+        if (goes_first(work[i], pivot, equal_left) != (i < split))
+            problem = "element on the wrong side";
+    if (problem == NULL) {
+        qsort(expected, n, sizeof(int64_t), compare_int64);
+        qsort(work, n, sizeof(int64_t), compare_int64);
+        if (memcmp(expected, work, n * sizeof(int64_t)) != 0)
+            problem = "not a permutation of the input";
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Error: %s kernel: %s (n=%lu, %s, pivot=%lld, %s)\n",
+                partition_kernel_name(kernel), problem, n, pattern_names[pattern],
+                (long long) pivot, equal_left ? "x <= pivot" : "x < pivot");
+        return 0;
+    }
+    return 1;
+}
+
+static unsigned long validate(void) {
+    static const unsigned long sizes[] = {
+        0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33, 63, 64, 65,
+        100, 127, 128, 129, 255, 256, 257, 511, 512, 513, 1000, 4099, 65536 + 13,
+    };
+    unsigned long max_n = 65536 + 13, cases = 0;
+    int64_t *input = malloc(max_n * sizeof(int64_t));
+    int64_t *expected = malloc(max_n * sizeof(int64_t));
+    int64_t *work = malloc(max_n * sizeof(int64_t));
+    if (input == NULL || expected == NULL || work == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned long n = sizes[s];
+        for (int pattern = 0; pattern < NUM_PATTERNS; pattern++) {
+            fill(input, n, pattern);
+            int64_t pivots[] = { INT64_MIN, INT64_MAX, 0, n > 0 ? input[n / 2] : 1, n > 0 ? input[0] : -1 };
+            for (size_t p = 0; p < sizeof(pivots) / sizeof(pivots[0]); p++) {
+                for (int equal_left = 0; equal_left <= 1; equal_left++) {
+                    for (int k = PARTITION_BLOCK; k < NUM_KERNELS; k++) {
+                        if (!partition_kernel_available(k))
+                            continue;
+                        if (!check(k, input, n, pivots[p], equal_left, pattern, expected, work))
+                            exit(1);
+                        cases++;
+                    }
+                }
+            }
+        }
+    }
+    free(input);
+    free(expected);
+    free(work);
+    return cases;
+}
+
+int main(void) {
+    enum PartitionKernel chosen = partition_kernel_current();
+    unsigned long cases = validate();
+    printf("%lu cases match the scalar reference\n", cases);
+
+    int64_t *input = malloc(BENCH_SIZE * sizeof(int64_t));
+    int64_t *work = malloc(BENCH_SIZE * sizeof(int64_t));
+    if (input == NULL || work == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    fill(input, BENCH_SIZE, RANDOM);
+
+    printf("%10s %12s %10s\n", "kernel", "ns/element", "speedup");
+    double t_scalar = 0;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (!partition_kernel_available(k)) {
+            printf("%10s %12s\n", partition_kernel_name(k), "unavailable");
+            continue;
+        }
+        partition_kernel_use(k);
+        double total = 0;
+        for (int r = 0; r < BENCH_REPS; r++) {
+            memcpy(work, input, BENCH_SIZE * sizeof(int64_t));
+            double start = now_sec();
+            partition_split(work, BENCH_SIZE, input[r], 0);
+            total += now_sec() - start;
+        }
+        double t = total * 1e9 / ((double) BENCH_SIZE * BENCH_REPS);
+        if (k == PARTITION_SCALAR)
+            t_scalar = t;
+        printf("%10s %12.3f %9.2fx%s\n", partition_kernel_name(k), t, t_scalar / t,
+               k == (int) chosen ? "  (default)" : "");
+    }
+    free(input);
+    free(work);
+    return 0;
+}
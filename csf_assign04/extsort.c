@@ -0,0 +1,625 @@
+// External merge sort for files larger than the memory budget.
+//
+// Phase 1 reads the file one run at a time into a buffer of the memory
+// budget's size. Each run is sorted by the thread engine and appended
+// to an unlinked temporary run file. Phase 2 merges all runs back into
+// the input file with a loser tree. Every run gets an input buffer that
+// is refilled with large sequential reads, and the kernel is asked to
+// read ahead the next block of that run while the current one is being
+// merged. The output is double-buffered: a writer thread writes one
+// buffer while the merge fills the other. Reads, merging and writes
+// therefore overlap.
+//
+// Streaming mode (file name "-") sorts stdin to stdout. Input is read
+// into two chunk buffers of half the budget each: while one chunk is
+// sorted and spilled to the run file by a second thread, the next one is
+// read into the other buffer. The runs are then merged to stdout the same
+// way. Input that fits in one chunk is sorted and written out directly.
+//
+// merge_files merges already sorted files into one output with the same
+// loser tree and writer. With --unique every merge drops keys equal to
+// the previous output, so duplicates cost no extra pass.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "parsort.h"
+
+// Smallest I/O buffer per run; budgets too small for this are exceeded
+#define MIN_IO_ELEMENTS ( 64UL * 1024 / sizeof(int64_t) )
+
+// One sorted run in a run file or input file, and its input buffer
+typedef struct {
+    int fd;
+    off_t next;                 // file offset of the next unread element
+    off_t end;                  // file offset one past the run
+    int64_t *buf;
+    unsigned long pos, len;     // position and fill level of buf
+    int done;
+} Run;
+
+typedef struct {
+    Run *runs;
+    unsigned num_runs;
+    unsigned long buf_elements;
+    unsigned *tree;             // tree[0]: winner, tree[1..k-1]: losers
+} Merger;
+
+// Double-buffered output written by a separate thread
+typedef struct {
+    int fd;
+    off_t offset;
+    int64_t *buf[2];
+    unsigned long len[2];       // elements in each buffer, 0 if free
+    unsigned long capacity;
+    int filling;                // buffer the merge is filling
+    int full;                   // buffer waiting for the writer, or -1
+    int finished, failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+} Writer;
+
+static int read_full(int fd, void *buf, size_t bytes, off_t offset) {
+    char *p = buf;
+    while (bytes > 0) {
+        ssize_t n = pread(fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+    return 1;
+}
+
+// Write at offset, or at the current position (for pipes) if offset < 0
+static int write_full(int fd, const void *buf, size_t bytes, off_t offset) {
+    const char *p = buf;
+    while (bytes > 0) {
+        ssize_t n = offset < 0 ? write(fd, p, bytes) : pwrite(fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        p += n;
+        bytes -= n;
+        if (offset >= 0)
+            offset += n;
+    }
+    return 1;
+}
+
+// Read from the current position until bytes are read or the input
+// ends. Returns the number of bytes read, or -1 on a read error.
+static ssize_t read_stream(int fd, void *buf, size_t bytes) {
+    char *p = buf;
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = read(fd, p + done, bytes - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+// Refill a run's buffer and start readahead of the block after it.
+// Returns 0 on a read error.
+static int run_refill(Merger *m, Run *r) {
+    r->pos = r->len = 0;
+    if (r->next >= r->end) {
+        r->done = 1;
+        return 1;
+    }
+    off_t bytes = r->end - r->next;
+    off_t max_bytes = (off_t) (m->buf_elements * sizeof(int64_t));
+    if (bytes > max_bytes)
+        bytes = max_bytes;
+    if (!read_full(r->fd, r->buf, bytes, r->next))
+        return 0;
+    r->next += bytes;
+    r->len = bytes / sizeof(int64_t);
+    if (r->next < r->end)
+        posix_fadvise(r->fd, r->next, max_bytes, POSIX_FADV_WILLNEED);
+    return 1;
+}
+
+// Whether run a's current element should come out before run b's
+static inline int run_less(const Merger *m, unsigned a, unsigned b) {
+    const Run *ra = &m->runs[a], *rb = &m->runs[b];
+    if (ra->done || rb->done)
+        return !ra->done;
+    int64_t x = ra->buf[ra->pos], y = rb->buf[rb->pos];
+    return x < y || (x == y && a < b);
+}
+
+// Build the loser tree: leaf i (node k + i) holds run i and every
+// internal node keeps the loser of the match played there.
+// Returns 0 if memory can't be allocated.
+static int tree_build(Merger *m) {
+    unsigned k = m->num_runs;
+    unsigned *winner = malloc(2 * k * sizeof(unsigned));
+    if (winner == NULL)
+        return 0;
+    for (unsigned i = 0; i < k; i++)
+        winner[k + i] = i;
+    for (unsigned n = k - 1; n >= 1; n--) {
+        unsigned a = winner[2 * n], b = winner[2 * n + 1];
+        int a_wins = run_less(m, a, b);
+        winner[n] = a_wins ? a : b;
+        m->tree[n] = a_wins ? b : a;
+    }
+    m->tree[0] = k > 1 ? winner[1] : 0;
+    free(winner);
+    return 1;
+}
+
+// Replay the matches from run s's leaf to the root after s advanced
+static inline void tree_replay(Merger *m, unsigned s) {
+    for (unsigned t = (s + m->num_runs) / 2; t > 0; t /= 2) {
+        if (run_less(m, m->tree[t], s)) {
+            unsigned tmp = m->tree[t];
+            m->tree[t] = s;
+            s = tmp;
+        }
+    }
+    m->tree[0] = s;
+}
+
+static void *writer_main(void *arg) {
+    Writer *w = arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->full < 0 && !w->finished)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->full < 0)
+            break;
+        int b = w->full;
+        pthread_mutex_unlock(&w->lock);
+
+        size_t bytes = w->len[b] * sizeof(int64_t);
+        int ok = write_full(w->fd, w->buf[b], bytes, w->offset);
+        if (w->offset >= 0)
+            w->offset += bytes;
+
+        pthread_mutex_lock(&w->lock);
+        if (!ok)
+            w->failed = 1;
+        w->len[b] = 0;
+        w->full = -1;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Hand the buffer being filled to the writer and switch to the other.
+// Returns 0 if an earlier write failed.
+static int writer_flush(Writer *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->full >= 0)
+        pthread_cond_wait(&w->cond, &w->lock);
+    w->full = w->filling;
+    w->filling = 1 - w->filling;
+    int ok = !w->failed;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+// Merge every run in m into out_fd, starting at out_offset (-1 for a
+// pipe). With unique, keys equal to the previous output are dropped.
+// *written is set to the number of elements written.
+static int merge_runs(Merger *m, int out_fd, off_t out_offset, int64_t *out_bufs, unsigned long out_capacity,
+                      int unique, unsigned long *written) {
+    Writer w = { .fd = out_fd, .offset = out_offset, .capacity = out_capacity,
+                 .filling = 0, .full = -1, .finished = 0, .failed = 0 };
+    w.buf[0] = out_bufs;
+    w.buf[1] = out_bufs + out_capacity;
+    w.len[0] = w.len[1] = 0;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    int threaded = pthread_create(&w.thread, NULL, writer_main, &w) == 0;
+
+    unsigned long count = 0;
+    int64_t last = 0;
+    int ok = tree_build(m);
+    while (ok && !m->runs[m->tree[0]].done) {
+        unsigned s = m->tree[0];
+        Run *r = &m->runs[s];
+        int64_t x = r->buf[r->pos++];
+        if (!unique || count == 0 || x != last) {
+            w.buf[w.filling][w.len[w.filling]++] = x;
+            last = x;
+            count++;
+        }
+        if (r->pos == r->len)
+            ok = run_refill(m, r);
+        tree_replay(m, s);
+
+        if (w.len[w.filling] == w.capacity) {
+            if (threaded) {
+                ok = writer_flush(&w) && ok;
+            } else {
+                size_t bytes = w.capacity * sizeof(int64_t);
+                ok = write_full(out_fd, w.buf[0], bytes, w.offset) && ok;
+                if (w.offset >= 0)
+                    w.offset += bytes;
+                w.len[0] = 0;
+            }
+        }
+    }
+
+    if (threaded) {
+        if (w.len[w.filling] > 0)
+            writer_flush(&w);
+        pthread_mutex_lock(&w.lock);
+        w.finished = 1;
+        pthread_cond_broadcast(&w.cond);
+        pthread_mutex_unlock(&w.lock);
+        pthread_join(w.thread, NULL);
+    } else if (w.len[0] > 0) {
+        w.failed |= !write_full(out_fd, w.buf[0], w.len[0] * sizeof(int64_t), w.offset);
+    }
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+
+    if (!ok || w.failed)
+        fprintf(stderr, "Error: I/O error while merging runs\n");
+    *written = count;
+    return ok && !w.failed;
+}
+
+// Sort one run in memory; returns 0 if the thread engine failed (it
+// reports why)
+static int sort_run(int64_t *buf, unsigned long n, const struct Options *opts) {
+    partition_configure(opts->num_threads, n);
+    unsigned long par_threshold = opts->par_threshold, min_threshold = 0;
+    if (opts->auto_threshold)
+        par_threshold = auto_par_threshold(buf, n, opts, &min_threshold);
+    return quicksort_threads(buf, n, par_threshold, min_threshold, opts->num_threads);
+}
+
+// A chunk of the input being sorted and written to the run file by a
+// separate thread
+typedef struct {
+    int64_t *buf;
+    unsigned long len;
+    int run_fd;
+    off_t offset;
+    const struct Options *opts;
+    int ok, running;
+    pthread_t thread;
+} Spill;
+
+static void *spill_main(void *arg) {
+    Spill *s = arg;
+    s->ok = sort_run(s->buf, s->len, s->opts)
+            && write_full(s->run_fd, s->buf, s->len * sizeof(int64_t), s->offset);
+    return NULL;
+}
+
+// Sort and write a chunk in the background, or inline if no thread can
+// be created
+static void spill_start(Spill *s) {
+    s->running = pthread_create(&s->thread, NULL, spill_main, s) == 0;
+    if (!s->running)
+        spill_main(s);
+}
+
+// Wait for a chunk started by spill_start; returns 0 if it failed
+static int spill_wait(Spill *s) {
+    if (s->running)
+        pthread_join(s->thread, NULL);
+    s->running = 0;
+    return s->ok;
+}
+
+// Create an unlinked temporary file for the runs; returns -1 on failure
+static int create_run_file(const char *scratch_dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/parsort-runs-XXXXXX", scratch_dir);
+    int run_fd = mkstemp(path);
+    if (run_fd < 0) {
+        fprintf(stderr, "Error: can't create run file in '%s'\n", scratch_dir);
+        return -1;
+    }
+    unlink(path);
+    return run_fd;
+}
+
+// Phase 2: merge num_runs runs of run_elements elements (the last may be
+// shorter), n elements in all, from run_fd into out_fd at out_offset.
+// *buf, buf_elements long, is split between one input buffer per run and
+// the two output buffers; it is enlarged if that leaves less than
+// MIN_IO_ELEMENTS per buffer. *written is set to the number of elements
+// written, which is less than n with --unique.
+static int merge_run_file(int run_fd, unsigned long n, unsigned long run_elements, unsigned num_runs,
+                          int64_t **buf, unsigned long buf_elements, int out_fd, off_t out_offset,
+                          const struct Options *opts, unsigned long *written) {
+    int ok = 1;
+    Merger m = { .num_runs = num_runs };
+    m.buf_elements = buf_elements / (num_runs + 2);
+    if (m.buf_elements < MIN_IO_ELEMENTS) {
+        m.buf_elements = MIN_IO_ELEMENTS;
+        int64_t *bigger = realloc(*buf, (num_runs + 2) * m.buf_elements * sizeof(int64_t));
+        if (bigger == NULL)
+            ok = 0;
+        else
+            *buf = bigger;
+        if (opts->verbose)
+            fprintf(stderr, "external: %u runs need more than the memory budget\n", num_runs);
+    }
+    m.runs = calloc(num_runs, sizeof(Run));
+    m.tree = calloc(num_runs, sizeof(unsigned));
+    if (m.runs == NULL || m.tree == NULL)
+        ok = 0;
+    for (unsigned i = 0; ok && i < num_runs; i++) {
+        Run *r = &m.runs[i];
+        r->fd = run_fd;
+        r->next = (off_t) i * run_elements * sizeof(int64_t);
+        r->end = (i == num_runs - 1) ? (off_t) (n * sizeof(int64_t)) : r->next + (off_t) (run_elements * sizeof(int64_t));
+        r->buf = *buf + (unsigned long) i * m.buf_elements;
+        ok = run_refill(&m, r);
+    }
+    if (ok)
+        ok = merge_runs(&m, out_fd, out_offset, *buf + (unsigned long) num_runs * m.buf_elements, m.buf_elements,
+                        opts->unique, written);
+
+    free(m.runs);
+    free(m.tree);
+    return ok;
+}
+
+int external_sort_file(const struct Options *opts, const char *scratch_dir) {
+    const char *filename = opts->filename;
+    int fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "Error: can't open file '%s'\n", filename);
+        return 0;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        fprintf(stderr, "Error: fstat failed\n");
+        close(fd);
+        return 0;
+    }
+    unsigned long n = statbuf.st_size / sizeof(int64_t);
+    unsigned long run_elements = opts->memory_budget / sizeof(int64_t);
+    if (run_elements < MIN_IO_ELEMENTS)
+        run_elements = MIN_IO_ELEMENTS;
+    if (run_elements > n)
+        run_elements = n;
+    if (n < 2) {
+        close(fd);
+        return 1;
+    }
+
+    int64_t *buf = malloc(run_elements * sizeof(int64_t));
+    if (buf == NULL) {
+        fprintf(stderr, "Error: can't allocate the run buffer\n");
+        close(fd);
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // A file that fits in the budget is a single run sorted in place
+    if (run_elements == n) {
+        size_t bytes = n * sizeof(int64_t);
+        int ok = read_full(fd, buf, bytes, 0);
+        int sorted = ok && sort_run(buf, n, opts);
+        if (sorted) {
+            if (opts->unique)
+                bytes = unique_int64(buf, n) * sizeof(int64_t);
+            ok = write_full(fd, buf, bytes, 0) && ftruncate(fd, bytes) == 0;
+        }
+        if (!ok)
+            fprintf(stderr, "Error: I/O error on '%s'\n", filename);
+        ok = ok && sorted;
+        free(buf);
+        close(fd);
+        return ok;
+    }
+
+    int run_fd = create_run_file(scratch_dir);
+    if (run_fd < 0) {
+        free(buf);
+        close(fd);
+        return 0;
+    }
+
+    // Phase 1: sorted runs, in the same order and at the same offsets
+    // as in the input
+    unsigned num_runs = (n + run_elements - 1) / run_elements;
+    int ok = 1, sorted = 1;
+    for (unsigned i = 0; ok && sorted && i < num_runs; i++) {
+        off_t offset = (off_t) i * run_elements * sizeof(int64_t);
+        unsigned long len = (i == num_runs - 1) ? n - (unsigned long) i * run_elements : run_elements;
+        ok = read_full(fd, buf, len * sizeof(int64_t), offset);
+        sorted = ok && sort_run(buf, len, opts);
+        if (sorted)
+            ok = write_full(run_fd, buf, len * sizeof(int64_t), offset);
+    }
+    if (!ok)
+        fprintf(stderr, "Error: I/O error while writing runs\n");
+    ok = ok && sorted;
+    if (opts->verbose)
+        fprintf(stderr, "external: %lu elements in %u runs of up to %lu\n", n, num_runs, run_elements);
+
+    unsigned long written = n;
+    if (ok)
+        ok = merge_run_file(run_fd, n, run_elements, num_runs, &buf, run_elements, fd, 0, opts, &written);
+    if (ok && written < n)
+        ok = ftruncate(fd, (off_t) (written * sizeof(int64_t))) == 0;
+
+    free(buf);
+    close(run_fd);
+    if (close(fd) != 0)
+        ok = 0;
+    return ok;
+}
+
+int external_sort_stream(const struct Options *opts, const char *scratch_dir, int in_fd, int out_fd) {
+    unsigned long chunk = opts->memory_budget / 2 / sizeof(int64_t);
+    if (chunk < MIN_IO_ELEMENTS)
+        chunk = MIN_IO_ELEMENTS;
+    size_t chunk_bytes = chunk * sizeof(int64_t);
+    int64_t *buf = malloc(2 * chunk_bytes);
+    if (buf == NULL) {
+        fprintf(stderr, "Error: can't allocate the chunk buffers\n");
+        return 0;
+    }
+
+    ssize_t got = read_stream(in_fd, buf, chunk_bytes);
+    if (got < 0 || got % sizeof(int64_t) != 0) {
+        fprintf(stderr, got < 0 ? "Error: read error on input\n"
+                                : "Error: input is not a whole number of int64 values\n");
+        free(buf);
+        return 0;
+    }
+
+    // Input that fits in one chunk needs no run file
+    if ((size_t) got < chunk_bytes) {
+        unsigned long n = got / sizeof(int64_t);
+        if (n > 1 && !sort_run(buf, n, opts)) {
+            free(buf);
+            return 0;
+        }
+        if (opts->unique)
+            got = unique_int64(buf, n) * sizeof(int64_t);
+        int ok = write_full(out_fd, buf, got, -1);
+        if (!ok)
+            fprintf(stderr, "Error: write error on output\n");
+        if (opts->verbose)
+            fprintf(stderr, "stream: %lu elements in one chunk\n", n);
+        free(buf);
+        return ok;
+    }
+
+    int run_fd = create_run_file(scratch_dir);
+    if (run_fd < 0) {
+        free(buf);
+        return 0;
+    }
+
+    // Phase 1: each full buffer is sorted and spilled in the background
+    // while the next chunk is read into the other buffer
+    Spill spill[2];
+    for (int i = 0; i < 2; i++)
+        spill[i] = (Spill) { .buf = buf + i * chunk, .run_fd = run_fd, .opts = opts, .ok = 1 };
+    unsigned long n = 0;
+    unsigned num_runs = 0;
+    int cur = 0, ok = 1;
+    for (;;) {
+        spill[cur].len = got / sizeof(int64_t);
+        spill[cur].offset = (off_t) n * sizeof(int64_t);
+        spill_start(&spill[cur]);
+        n += spill[cur].len;
+        num_runs++;
+        int last = (size_t) got < chunk_bytes;
+
+        cur = 1 - cur;
+        ok = spill_wait(&spill[cur]) && ok;
+        if (last || !ok)
+            break;
+        got = read_stream(in_fd, spill[cur].buf, chunk_bytes);
+        if (got < 0 || got % sizeof(int64_t) != 0) {
+            fprintf(stderr, got < 0 ? "Error: read error on input\n"
+                                    : "Error: input is not a whole number of int64 values\n");
+            ok = 0;
+            break;
+        }
+        if (got == 0)
+            break;
+    }
+    ok = spill_wait(&spill[1 - cur]) && ok;
+    if (!ok)
+        fprintf(stderr, "Error: I/O error while writing runs\n");
+    if (opts->verbose)
+        fprintf(stderr, "stream: %lu elements in %u runs of up to %lu\n", n, num_runs, chunk);
+
+    // Phase 2: merge to the output, using both chunk buffers
+    unsigned long written;
+    if (ok)
+        ok = merge_run_file(run_fd, n, chunk, num_runs, &buf, 2 * chunk, out_fd, -1, opts, &written);
+
+    free(buf);
+    close(run_fd);
+    return ok;
+}
+
+int merge_files(const struct Options *opts, char *const *paths, unsigned num_files, const char *output) {
+    Merger m = { .num_runs = num_files };
+    m.runs = calloc(num_files, sizeof(Run));
+    m.tree = calloc(num_files, sizeof(unsigned));
+    m.buf_elements = opts->memory_budget / sizeof(int64_t) / (num_files + 2);
+    if (m.buf_elements < MIN_IO_ELEMENTS)
+        m.buf_elements = MIN_IO_ELEMENTS;
+    int64_t *buf = malloc((num_files + 2) * m.buf_elements * sizeof(int64_t));
+    if (m.runs == NULL || m.tree == NULL || buf == NULL) {
+        fprintf(stderr, "Error: can't allocate merge buffers\n");
+        free(m.runs);
+        free(m.tree);
+        free(buf);
+        return 0;
+    }
+
+    int ok = 1;
+    unsigned opened = 0;
+    unsigned long n = 0;
+    for (; ok && opened < num_files; opened++) {
+        Run *r = &m.runs[opened];
+        struct stat statbuf;
+        r->fd = open(paths[opened], O_RDONLY);
+        if (r->fd < 0 || fstat(r->fd, &statbuf) != 0) {
+            fprintf(stderr, "Error: can't open file '%s'\n", paths[opened]);
+            if (r->fd >= 0)
+                close(r->fd);
+            ok = 0;
+            break;
+        }
+        r->next = 0;
+        r->end = statbuf.st_size / sizeof(int64_t) * sizeof(int64_t);
+        r->buf = buf + (unsigned long) opened * m.buf_elements;
+        n += r->end / sizeof(int64_t);
+        posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ok = run_refill(&m, r);
+    }
+
+    int out_fd = -1;
+    if (ok) {
+        out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            fprintf(stderr, "Error: can't create output file '%s'\n", output);
+            ok = 0;
+        }
+    }
+    unsigned long written = 0;
+    if (ok)
+        ok = merge_runs(&m, out_fd, 0, buf + (unsigned long) num_files * m.buf_elements, m.buf_elements,
+                        opts->unique, &written);
+    if (out_fd >= 0 && close(out_fd) != 0)
+        ok = 0;
+    if (opts->verbose)
+        fprintf(stderr, "merge: %lu elements from %u files, %lu written\n", n, num_files, written);
+
+    for (unsigned i = 0; i < opened; i++)
+        if (m.runs[i].fd >= 0)
+            close(m.runs[i].fd);
+    free(m.runs);
+    free(m.tree);
+    free(buf);
+    return ok;
+}
@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RAND_SEED 1
+
+// Number of distinct values in the "fewunique" pattern
+#define FEW_UNIQUE 16
+
+// Number of distinct random keys in the "duplicates" pattern
+#define DUPLICATE_KEYS 1024
+
+// Distinct values and exponent of the "zipf" pattern
+#define ZIPF_VALUES 65536
+#define ZIPF_EXPONENT 1.1
+
+// Elements per ascending run in the "runs" pattern
+#define RUN_LENGTH 4096
+
+// Standard deviation of the "gaussian" pattern
+#define GAUSSIAN_STDDEV 1e12
+
+static const char *patterns[] = {
+  "random", "uniform", "sorted", "reverse", "equal", "fewunique", "organpipe",
+  "gaussian", "zipf", "runs", "duplicates", NULL
+};
+
+static uint64_t rng_state = RAND_SEED;
+
+// Cumulative probabilities of the zipf ranks, and the random key of
+// each rank and of each duplicate key
+static double *zipf_cdf;
+static int64_t *zipf_keys, *duplicate_keys;
+
+// xorshift64*: the C library rand() has too few bits for int64_t values
+static uint64_t next_rand(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform double in [0, 1)
+static double next_unit(void) {
+  return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Set up the tables used by the zipf and duplicates patterns
+static int init_tables(const char *pattern) {
+  if (strcmp(pattern, "zipf") == 0) {
+    zipf_cdf = malloc(ZIPF_VALUES * sizeof(double));
+    zipf_keys = malloc(ZIPF_VALUES * sizeof(int64_t));
+    if (zipf_cdf == NULL || zipf_keys == NULL)
+      return 0;
+    double total = 0;
+    for (int k = 0; k < ZIPF_VALUES; k++) {
+      total += 1.0 / pow(k + 1, ZIPF_EXPONENT);
+      zipf_cdf[k] = total;
+      zipf_keys[k] = (int64_t) next_rand();
+    }
+    for (int k = 0; k < ZIPF_VALUES; k++)
+      zipf_cdf[k] /= total;
+  } else if (strcmp(pattern, "duplicates") == 0) {
+    duplicate_keys = malloc(DUPLICATE_KEYS * sizeof(int64_t));
+    if (duplicate_keys == NULL)
+      return 0;
+    for (int k = 0; k < DUPLICATE_KEYS; k++)
+      duplicate_keys[k] = (int64_t) next_rand();
+  }
+  return 1;
+}
+
+// Random key of a zipf-distributed rank (rank 1 is the most frequent)
+static int64_t zipf_value(void) {
+  double u = next_unit();
+  int lo = 0, hi = ZIPF_VALUES - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (zipf_cdf[mid] < u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return zipf_keys[lo];
+}
+
+// Normally distributed value around 0 (Box-Muller)
+static int64_t gaussian_value(void) {
+  double u1 = 1.0 - next_unit(), u2 = next_unit();
+  return (int64_t) (GAUSSIAN_STDDEV * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+// Value of element i out of n for the given pattern
+static int64_t pattern_value(const char *pattern, size_t i, size_t n) {
+  static int64_t run_value;
+
+  if (strcmp(pattern, "random") == 0 || strcmp(pattern, "uniform") == 0)
+    return (int64_t) next_rand();
+  if (strcmp(pattern, "gaussian") == 0)
+    return gaussian_value();
+  if (strcmp(pattern, "zipf") == 0)
+    return zipf_value();
+  if (strcmp(pattern, "duplicates") == 0)
+    return duplicate_keys[next_rand() % DUPLICATE_KEYS];
+  if (strcmp(pattern, "runs") == 0) {
+    // each run starts at a random value and ascends in small steps
+    if (i % RUN_LENGTH == 0)
+      run_value = (int64_t) (next_rand() >> 1) - INT64_MAX / 2;
+    run_value += next_rand() % 1024;
+    return run_value;
+  }
+  if (strcmp(pattern, "sorted") == 0)
+    return (int64_t) i;
+  if (strcmp(pattern, "reverse") == 0)
+    return (int64_t) (n - i);
+  if (strcmp(pattern, "equal") == 0)
+    return 42;
+  if (strcmp(pattern, "fewunique") == 0)
+    return (int64_t) (next_rand() % FEW_UNIQUE);
+  // organpipe: ascending to the middle, then descending
+  return (int64_t) (i < n / 2 ? i : n - i);
+}
+
+static void usage(const char *progname) {
+  fprintf(stderr, "Usage: %s <pattern> <size> <output filename> [seed]\n"
+                  "  <pattern> is one of:", progname);
+  for (int i = 0; patterns[i] != NULL; i++)
+    fprintf(stderr, " %s", patterns[i]);
+  fprintf(stderr, "\n  <size> is in bytes and can have 'M' suffix for size in megabytes\n"
+                  "  [seed] selects the random sequence (default: %d)\n", RAND_SEED);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 4 && argc != 5)
+    usage(argv[0]);
+
+  const char *pattern = argv[1];
+  int known = 0;
+  for (int i = 0; patterns[i] != NULL; i++)
+    known |= (strcmp(pattern, patterns[i]) == 0);
+  if (!known)
+    usage(argv[0]);
+
+  char *end;
+  size_t size = strtoul(argv[2], &end, 10);
+  if (*end == 'M')
+    size *= (1024U * 1024U);
+  size_t n = size / sizeof(int64_t);
+
+  if (argc == 5) {
+    rng_state = strtoull(argv[4], &end, 10);
+    if (*end != '\0')
+      usage(argv[0]);
+  }
+  // xorshift never leaves the all-zero state
+  if (rng_state == 0)
+    rng_state = RAND_SEED;
+  if (!init_tables(pattern)) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  FILE *out = fopen(argv[3], "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Couldn't open '%s' for output\n", argv[3]);
+    return 1;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    int64_t v = pattern_value(pattern, i, n);
+    if (fwrite(&v, sizeof(int64_t), 1, out) != 1) {
+      fclose(out);
+      fprintf(stderr, "Error: fwrite failed\n");
+      return 1;
+    }
+  }
+
+  fclose(out);
+  printf("Wrote %lu bytes (%s) to '%s'\n", n * sizeof(int64_t), pattern, argv[3]);
+
+  return 0;
+}
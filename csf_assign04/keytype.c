@@ -0,0 +1,253 @@
+// Element types other than int64_t (--type).
+//
+// Rather than instantiating every engine once per type, each element is
+// encoded as an int64_t key that orders the same way, the keys are
+// sorted by the int64_t engines (with their vector kernels and radix
+// passes unchanged), and decoded again:
+//
+// int64    the value itself; nothing is encoded
+// uint64   the sign bit flipped
+// int32    sign-extended
+// uint32   zero-extended
+// double   the IEEE bits read as an integer; for negative numbers the
+// float    bits below the sign are flipped, so larger magnitudes sort
+//          lower. -0.0 sorts just before 0.0, and NaNs sort after +inf
+//          (or before -inf, if their sign bit is set).
+//
+// Every mapping is a bijection, so --unique and --select work on the
+// keys as well. The one exception is --unique on doubles and floats:
+// -0.0 and 0.0 compare equal, so -0.0 is encoded as 0.0 and only 0.0
+// is kept. The encoder and decoder of each type are generated by
+// DEFINE_KEY_TYPE with the conversion inlined into the loop. 8-byte
+// types are encoded in place in the mapped file; 4-byte types are
+// widened into a buffer shared with the fork engine's children and
+// narrowed back into the file afterwards. Both passes are split
+// between the -t threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "parsort.h"
+
+typedef struct {
+    const void *src;
+    void *dst;
+    enum KeyType type;
+    int decode;
+    int merge_zeros;            // encode -0.0 as 0.0
+    unsigned long start, end;   // elements of this thread
+    pthread_t thread;
+} KeyWorker;
+
+// Flip the bits below the sign of negative values: orders IEEE floats
+// as integers, and undoes itself
+static inline int64_t flip64(int64_t s) {
+    return s ^ ((s >> 63) & INT64_MAX);
+}
+
+static inline int32_t flip32(int32_t s) {
+    return s ^ ((s >> 31) & INT32_MAX);
+}
+
+// Key of -0.0 for both double and float (all bits below the sign
+// flipped), and of 0.0
+#define NEGATIVE_ZERO_KEY (-1)
+#define ZERO_KEY 0
+
+// name_encode and name_decode convert elements [start, end) between
+// the type (stored as bits_t bits) and int64_t keys
+#define DEFINE_KEY_TYPE(name, bits_t, to_key, from_key)                         \
+    static void name##_encode(const void *src, int64_t *keys,                  \
+                              unsigned long start, unsigned long end) {         \
+        const unsigned char *elts = src;                                        \
+        for (unsigned long i = start; i < end; i++) {                           \
+            bits_t b;                                                           \
+            memcpy(&b, elts + i * sizeof(bits_t), sizeof(b));                   \
+            keys[i] = (to_key);                                                 \
+        }                                                                       \
+    }                                                                           \
+    static void name##_decode(const int64_t *keys, void *dst,                  \
+                              unsigned long start, unsigned long end) {         \
+        unsigned char *elts = dst;                                              \
+        for (unsigned long i = start; i < end; i++) {                           \
+            int64_t key = keys[i];                                              \
+            bits_t b = (from_key);                                              \
+            memcpy(elts + i * sizeof(bits_t), &b, sizeof(b));                   \
+        }                                                                       \
+    }
+
+DEFINE_KEY_TYPE(uint64, uint64_t, (int64_t) (b ^ (1ULL << 63)), (uint64_t) key ^ (1ULL << 63))
+DEFINE_KEY_TYPE(double, uint64_t, flip64((int64_t) b), (uint64_t) flip64(key))
+DEFINE_KEY_TYPE(int32, uint32_t, (int32_t) b, (uint32_t) key)
+DEFINE_KEY_TYPE(uint32, uint32_t, b, (uint32_t) key)
+DEFINE_KEY_TYPE(float, uint32_t, flip32((int32_t) b), (uint32_t) flip32((int32_t) key))
+
+static const struct {
+    const char *name;
+    size_t size;
+} key_types[] = {
+    [KEY_INT64] = { "int64", sizeof(int64_t) },
+    [KEY_UINT64] = { "uint64", sizeof(uint64_t) },
+    [KEY_DOUBLE] = { "double", sizeof(double) },
+    [KEY_INT32] = { "int32", sizeof(int32_t) },
+    [KEY_UINT32] = { "uint32", sizeof(uint32_t) },
+    [KEY_FLOAT] = { "float", sizeof(float) },
+};
+
+int parse_key_type(const char *name, enum KeyType *type) {
+    for (unsigned t = 0; t < sizeof(key_types) / sizeof(key_types[0]); t++) {
+        if (strcmp(name, key_types[t].name) == 0) {
+            *type = t;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *key_type_name(enum KeyType type) {
+    return key_types[type].name;
+}
+
+size_t key_type_size(enum KeyType type) {
+    return key_types[type].size;
+}
+
+static void *convert_chunk(void *arg) {
+    KeyWorker *w = arg;
+    if (w->decode) {
+        switch (w->type) {
+        case KEY_UINT64: uint64_decode(w->src, w->dst, w->start, w->end); break;
+        case KEY_DOUBLE: double_decode(w->src, w->dst, w->start, w->end); break;
+        case KEY_INT32: int32_decode(w->src, w->dst, w->start, w->end); break;
+        case KEY_UINT32: uint32_decode(w->src, w->dst, w->start, w->end); break;
+        case KEY_FLOAT: float_decode(w->src, w->dst, w->start, w->end); break;
+        default: break;
+        }
+    } else {
+        switch (w->type) {
+        case KEY_UINT64: uint64_encode(w->src, w->dst, w->start, w->end); break;
+        case KEY_DOUBLE: double_encode(w->src, w->dst, w->start, w->end); break;
+        case KEY_INT32: int32_encode(w->src, w->dst, w->start, w->end); break;
+        case KEY_UINT32: uint32_encode(w->src, w->dst, w->start, w->end); break;
+        case KEY_FLOAT: float_encode(w->src, w->dst, w->start, w->end); break;
+        default: break;
+        }
+        if (w->merge_zeros) {
+            int64_t *keys = w->dst;
+            for (unsigned long i = w->start; i < w->end; i++)
+                if (keys[i] == NEGATIVE_ZERO_KEY)
+                    keys[i] = ZERO_KEY;
+        }
+    }
+    return NULL;
+}
+
+// Convert n elements from src to dst with up to num_threads threads
+static void convert(const void *src, void *dst, unsigned long n, enum KeyType type,
+                    int decode, int merge_zeros, unsigned num_threads) {
+    if (n == 0)
+        return;
+    unsigned nt = num_threads > 0 ? num_threads : 1;
+    if (nt > n)
+        nt = n;
+    KeyWorker workers[nt];
+    int started[nt];
+    for (unsigned t = 0; t < nt; t++) {
+        KeyWorker *w = &workers[t];
+        w->src = src;
+        w->dst = dst;
+        w->type = type;
+        w->decode = decode;
+        w->merge_zeros = merge_zeros;
+        w->start = n * t / nt;
+        w->end = n * (t + 1) / nt;
+    }
+    for (unsigned t = 1; t < nt; t++)
+        started[t] = pthread_create(&workers[t].thread, NULL, convert_chunk, &workers[t]) == 0;
+    convert_chunk(&workers[0]);
+    for (unsigned t = 1; t < nt; t++) {
+        if (started[t])
+            pthread_join(workers[t].thread, NULL);
+        else
+            convert_chunk(&workers[t]);
+    }
+}
+
+int64_t *encode_keys(void *data, unsigned long n, const struct Options *opts) {
+    if (opts->key_type == KEY_INT64)
+        return data;
+    int64_t *keys = data;
+    if (key_type_size(opts->key_type) != sizeof(int64_t)) {
+        // shared, so that the fork engine's children sort it in place
+        keys = mmap(NULL, (n > 0 ? n : 1) * sizeof(int64_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (keys == MAP_FAILED) {
+            fprintf(stderr, "Error: can't allocate %lu keys\n", n);
+            return NULL;
+        }
+    }
+    int merge_zeros = opts->unique && (opts->key_type == KEY_DOUBLE || opts->key_type == KEY_FLOAT);
+    convert(data, keys, n, opts->key_type, 0, merge_zeros, opts->num_threads);
+    return keys;
+}
+
+void decode_keys(int64_t *keys, void *data, unsigned long count, unsigned long n,
+                 const struct Options *opts) {
+    if (opts->key_type == KEY_INT64)
+        return;
+    convert(keys, data, count, opts->key_type, 1, 0, opts->num_threads);
+    if ((void *) keys != data)
+        munmap(keys, (n > 0 ? n : 1) * sizeof(int64_t));
+}
+
+int64_t key_load(const void *elt, enum KeyType type) {
+    int64_t key;
+    switch (type) {
+    case KEY_UINT64: uint64_encode(elt, &key, 0, 1); break;
+    case KEY_DOUBLE: double_encode(elt, &key, 0, 1); break;
+    case KEY_INT32: int32_encode(elt, &key, 0, 1); break;
+    case KEY_UINT32: uint32_encode(elt, &key, 0, 1); break;
+    case KEY_FLOAT: float_encode(elt, &key, 0, 1); break;
+    default: memcpy(&key, elt, sizeof(key)); break;
+    }
+    return key;
+}
+
+void print_key(FILE *out, int64_t key, enum KeyType type) {
+    union {
+        int64_t i64;
+        uint64_t u64;
+        double f64;
+        int32_t i32;
+        uint32_t u32;
+        float f32;
+    } v;
+    switch (type) {
+    case KEY_UINT64:
+        uint64_decode(&key, &v, 0, 1);
+        fprintf(out, "%" PRIu64 "\n", v.u64);
+        break;
+    case KEY_DOUBLE:
+        double_decode(&key, &v, 0, 1);
+        fprintf(out, "%.17g\n", v.f64);
+        break;
+    case KEY_INT32:
+        int32_decode(&key, &v, 0, 1);
+        fprintf(out, "%" PRId32 "\n", v.i32);
+        break;
+    case KEY_UINT32:
+        uint32_decode(&key, &v, 0, 1);
+        fprintf(out, "%" PRIu32 "\n", v.u32);
+        break;
+    case KEY_FLOAT:
+        float_decode(&key, &v, 0, 1);
+        fprintf(out, "%.9g\n", v.f32);
+        break;
+    default:
+        fprintf(out, "%" PRId64 "\n", key);
+        break;
+    }
+}
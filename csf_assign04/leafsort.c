@@ -0,0 +1,269 @@
+// Sequential int64_t sort used for the leaves of every parallel engine.
+//
+// This is an introsort specialized for int64_t: comparisons are inlined
+// instead of going through a qsort comparator, partitioning is
+// branchless, and recursion that goes too deep falls back to heapsort.
+// Ranges of at most SMALL_SORT elements are finished by insertion sort
+// or, on CPUs with AVX2, by an in-register sorting network chosen at
+// startup.
+
+#include <stdint.h>
+#include "parsort.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Ranges at most this long are handed to the small sort
+#define SMALL_SORT 16
+
+// Ranges at least this long pick their pivot by ninther
+#define NINTHER_MIN 128
+
+// Ranges at least this long are partitioned by partition_split, which
+// uses the vector kernels where the CPU has them
+#define KERNEL_PARTITION_MIN 256
+
+static void insertion_sort(int64_t *arr, unsigned long n) {
+    for (unsigned long i = 1; i < n; i++) {
+        int64_t x = arr[i];
+        unsigned long j = i;
+        while (j > 0 && arr[j - 1] > x) {
+            arr[j] = arr[j - 1];
+            j--;
+        }
+        arr[j] = x;
+    }
+}
+
+static void sift_down(int64_t *arr, unsigned long root, unsigned long n) {
+    int64_t x = arr[root];
+    unsigned long child;
+    while ((child = 2 * root + 1) < n) {
+        if (child + 1 < n && arr[child + 1] > arr[child])
+            child++;
+        if (arr[child] <= x)
+            break;
+        arr[root] = arr[child];
+        root = child;
+    }
+    arr[root] = x;
+}
+
+static void heapsort_int64(int64_t *arr, unsigned long n) {
+    for (unsigned long i = n / 2; i-- > 0; )
+        sift_down(arr, i, n);
+    for (unsigned long end = n - 1; end > 0; end--) {
+        int64_t top = arr[0];
+        arr[0] = arr[end];
+        arr[end] = top;
+        sift_down(arr, 0, end);
+    }
+}
+
+#if defined(__x86_64__)
+// AVX2 has no 64-bit min/max, so build them from a compare and blend
+#define AVX2_FN __attribute__((target("avx2")))
+
+static inline AVX2_FN void minmax4(__m256i *a, __m256i *b) {
+    __m256i gt = _mm256_cmpgt_epi64(*a, *b);
+    __m256i lo = _mm256_blendv_epi8(*a, *b, gt);
+    *b = _mm256_blendv_epi8(*b, *a, gt);
+    *a = lo;
+}
+
+// Sort a bitonic vector of 4 elements
+static inline AVX2_FN __m256i bitonic_sort4(__m256i v) {
+    __m256i p = _mm256_permute4x64_epi64(v, 0x4E);    // swap 128-bit halves
+    __m256i gt = _mm256_cmpgt_epi64(v, p);
+    __m256i mn = _mm256_blendv_epi8(v, p, gt), mx = _mm256_blendv_epi8(p, v, gt);
+    v = _mm256_blend_epi32(mn, mx, 0xF0);
+    p = _mm256_permute4x64_epi64(v, 0xB1);             // swap neighbors
+    gt = _mm256_cmpgt_epi64(v, p);
+    mn = _mm256_blendv_epi8(v, p, gt);
+    mx = _mm256_blendv_epi8(p, v, gt);
+    return _mm256_blend_epi32(mn, mx, 0xCC);
+}
+
+// Merge two sorted 4-vectors into a sorted 8-sequence (a low, b high)
+static inline AVX2_FN void merge4x2(__m256i *a, __m256i *b) {
+    *b = _mm256_permute4x64_epi64(*b, 0x1B);           // reverse
+    minmax4(a, b);
+    *a = bitonic_sort4(*a);
+    *b = bitonic_sort4(*b);
+}
+
+// Sorting network for up to 16 elements held in four registers
+static AVX2_FN void small_sort_avx2(int64_t *arr, unsigned long n) {
+    int64_t buf[SMALL_SORT];
+    for (unsigned long i = 0; i < SMALL_SORT; i++)
+        buf[i] = i < n ? arr[i] : INT64_MAX;
+
+    __m256i r0 = _mm256_loadu_si256((const __m256i *) (buf + 0));
+    __m256i r1 = _mm256_loadu_si256((const __m256i *) (buf + 4));
+    __m256i r2 = _mm256_loadu_si256((const __m256i *) (buf + 8));
+    __m256i r3 = _mm256_loadu_si256((const __m256i *) (buf + 12));
+
+    // sort the four columns with a 5-comparator network
+    minmax4(&r0, &r1);
+    minmax4(&r2, &r3);
+    minmax4(&r0, &r2);
+    minmax4(&r1, &r3);
+    minmax4(&r1, &r2);
+
+    // transpose so that each register holds a sorted column
+    __m256i t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+    r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+    r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+    r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+    r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+    // 4+4 -> 8 twice, then 8+8 -> 16
+    merge4x2(&r0, &r1);
+    merge4x2(&r2, &r3);
+    __m256i s2 = _mm256_permute4x64_epi64(r3, 0x1B);
+    __m256i s3 = _mm256_permute4x64_epi64(r2, 0x1B);
+    minmax4(&r0, &s2);
+    minmax4(&r1, &s3);
+    minmax4(&r0, &r1);
+    minmax4(&s2, &s3);
+    r0 = bitonic_sort4(r0);
+    r1 = bitonic_sort4(r1);
+    s2 = bitonic_sort4(s2);
+    s3 = bitonic_sort4(s3);
+
+    _mm256_storeu_si256((__m256i *) (buf + 0), r0);
+    _mm256_storeu_si256((__m256i *) (buf + 4), r1);
+    _mm256_storeu_si256((__m256i *) (buf + 8), s2);
+    _mm256_storeu_si256((__m256i *) (buf + 12), s3);
+    for (unsigned long i = 0; i < n; i++)
+        arr[i] = buf[i];
+}
+#endif
+
+// Small sort selected once at startup by CPU feature detection
+static void (*small_sort)(int64_t *arr, unsigned long n) = insertion_sort;
+
+__attribute__((constructor))
+static void leafsort_dispatch(void) {
+    sort_int64_use_simd(1);
+}
+
+int sort_int64_simd_available(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+void sort_int64_use_simd(int enable) {
+    small_sort = insertion_sort;
+#if defined(__x86_64__)
+    if (enable && sort_int64_simd_available())
+        small_sort = small_sort_avx2;
+#endif
+}
+
+static inline void swap_elts(int64_t *arr, unsigned long i, unsigned long j) {
+    int64_t tmp = arr[i];
+    arr[i] = arr[j];
+    arr[j] = tmp;
+}
+
+// Move the median of arr[a], arr[b], arr[c] to arr[c]
+static inline void median_to(int64_t *arr, unsigned long a, unsigned long b, unsigned long c) {
+    if (arr[a] > arr[b]) swap_elts(arr, a, b);
+    if (arr[b] > arr[c]) swap_elts(arr, b, c);
+    if (arr[a] > arr[b]) swap_elts(arr, a, b);
+    swap_elts(arr, b, c);
+}
+
+// Index of the median of arr[a], arr[b], arr[c]
+static inline unsigned long median_index(const int64_t *arr, unsigned long a, unsigned long b, unsigned long c) {
+    if (arr[a] < arr[b])
+        return arr[b] < arr[c] ? b : (arr[a] < arr[c] ? c : a);
+    return arr[a] < arr[c] ? a : (arr[b] < arr[c] ? c : b);
+}
+
+// Move a pivot to arr[n - 1]: the median of three for short ranges,
+// Tukey's ninther for long ones so organ-pipe and sawtooth inputs don't
+// get an extreme pivot.
+static inline void pivot_to_end(int64_t *arr, unsigned long n) {
+    if (n < NINTHER_MIN) {
+        median_to(arr, 0, n / 2, n - 1);
+        return;
+    }
+    unsigned long s = n / 8, m = n / 2;
+    unsigned long a = median_index(arr, 0, s, 2 * s);
+    unsigned long b = median_index(arr, m - s, m, m + s);
+    unsigned long c = median_index(arr, n - 1 - 2 * s, n - 1 - s, n - 1);
+    swap_elts(arr, median_index(arr, a, b, c), n - 1);
+}
+
+// Branchless Lomuto partition around arr[n - 1]; every element is
+// swapped unconditionally and the boundary advances by the comparison
+// result, so random data causes no mispredicted branches. With
+// equal_left set, elements equal to the pivot go left instead of right.
+static inline unsigned long partition_branchless(int64_t *arr, unsigned long n, int equal_left) {
+    int64_t pivot = arr[n - 1];
+    unsigned long store = 0;
+    if (n >= KERNEL_PARTITION_MIN) {
+        store = partition_split(arr, n - 1, pivot, equal_left);
+    } else {
+        for (unsigned long i = 0; i < n - 1; i++) {
+            int64_t x = arr[i];
+            arr[i] = arr[store];
+            arr[store] = x;
+            store += equal_left ? (x <= pivot) : (x < pivot);
+        }
+    }
+    arr[n - 1] = arr[store];
+    arr[store] = pivot;
+    return store;
+}
+
+// Unless leftmost is set, arr[-1] is a pivot from an enclosing call and
+// no element of arr[0..n) is smaller than it. If the new pivot equals
+// it, the range holds a run of duplicates: they are split off in one
+// pass and never partitioned again, so few-unique inputs stay
+// O(n log k) instead of falling back to heapsort.
+static void introsort(int64_t *arr, unsigned long n, int depth_limit, int leftmost) {
+    while (n > SMALL_SORT) {
+        if (depth_limit-- == 0) {
+            heapsort_int64(arr, n);
+            return;
+        }
+        pivot_to_end(arr, n);
+
+        if (!leftmost && arr[-1] == arr[n - 1]) {
+            unsigned long mid = partition_branchless(arr, n, 1);
+            arr += mid + 1;
+            n -= mid + 1;
+            continue;
+        }
+        unsigned long mid = partition_branchless(arr, n, 0);
+
+        // recurse into the smaller side, loop on the larger one
+        if (mid < n - mid - 1) {
+            introsort(arr, mid, depth_limit, leftmost);
+            arr += mid + 1;
+            n -= mid + 1;
+            leftmost = 0;
+        } else {
+            introsort(arr + mid + 1, n - mid - 1, depth_limit, 0);
+            n = mid;
+        }
+    }
+    if (n > 1)
+        small_sort(arr, n);
+}
+
+void sort_int64(int64_t *arr, unsigned long n) {
+    if (n < 2)
+        return;
+    int depth_limit = 2 * (63 - __builtin_clzl(n));
+    introsort(arr, n, depth_limit, 1);
+}
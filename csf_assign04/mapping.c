@@ -0,0 +1,154 @@
+// Mapping strategies for the input file and NUMA placement of workers.
+//
+// The file is mapped MAP_SHARED as before. Strategy flags add
+// MAP_POPULATE (fault every page in up front), MADV_SEQUENTIAL or
+// MADV_HUGEPAGE on the whole mapping, and MADV_WILLNEED on every range
+// just before it is partitioned, so the kernel reads it in ahead of the
+// scan. Page faults are counted with getrusage, including child
+// processes of the fork engine, so strategies can be compared.
+//
+// NUMA nodes and their CPUs are read from sysfs. When binding is
+// enabled, worker w of n is pinned to the CPUs of node w * nodes / n.
+// Each thread's contiguous chunk (radix, sample) or first ranges are
+// then touched from one node. On a single-node host binding does
+// nothing.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "parsort.h"
+
+static const struct {
+    const char *name;
+    unsigned flag;
+} strategy_names[] = {
+    { "plain", 0 },
+    { "populate", MAPPING_POPULATE },
+    { "sequential", MAPPING_SEQUENTIAL },
+    { "willneed", MAPPING_WILLNEED },
+    { "hugepage", MAPPING_HUGEPAGE },
+};
+#define NUM_STRATEGY_NAMES (sizeof(strategy_names) / sizeof(strategy_names[0]))
+
+// Strategy of the current mapping, for prefetch_range
+static unsigned active_strategy = 0;
+
+static int numa_enabled = 0;
+
+int parse_map_strategy(const char *str, unsigned *strategy) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", str);
+    *strategy = 0;
+    for (char *save, *name = strtok_r(buf, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+        unsigned i = 0;
+        while (i < NUM_STRATEGY_NAMES && strcmp(name, strategy_names[i].name) != 0)
+            i++;
+        if (i == NUM_STRATEGY_NAMES)
+            return 0;
+        *strategy |= strategy_names[i].flag;
+    }
+    return 1;
+}
+
+int64_t *map_array(int fd, size_t size, unsigned strategy) {
+    int flags = MAP_SHARED;
+    if (strategy & MAPPING_POPULATE)
+        flags |= MAP_POPULATE;
+    int64_t *arr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (arr == MAP_FAILED)
+        return arr;
+
+    if ((strategy & MAPPING_SEQUENTIAL) && madvise(arr, size, MADV_SEQUENTIAL) != 0)
+        perror("Warning: madvise(MADV_SEQUENTIAL)");
+    if (strategy & MAPPING_HUGEPAGE) {
+#ifdef MADV_HUGEPAGE
+        if (madvise(arr, size, MADV_HUGEPAGE) != 0)
+            perror("Warning: madvise(MADV_HUGEPAGE)");
+#else
+        fprintf(stderr, "Warning: huge pages are not supported on this system\n");
+#endif
+    }
+    active_strategy = strategy;
+    return arr;
+}
+
+void prefetch_range(int64_t *arr, unsigned long start, unsigned long end) {
+    if (!(active_strategy & MAPPING_WILLNEED))
+        return;
+    // madvise needs a page-aligned start
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t) (arr + start) & ~(page - 1);
+    uintptr_t to = (uintptr_t) (arr + end);
+    madvise((void *) from, to - from, MADV_WILLNEED);
+}
+
+void report_page_faults(FILE *out, unsigned strategy) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    fprintf(out, "mapping:");
+    int any = 0;
+    for (unsigned i = 1; i < NUM_STRATEGY_NAMES; i++) {
+        if (strategy & strategy_names[i].flag) {
+            fprintf(out, "%s%s", any ? "," : " ", strategy_names[i].name);
+            any = 1;
+        }
+    }
+    if (!any)
+        fprintf(out, " plain");
+    fprintf(out, ", %ld minor and %ld major page faults\n",
+            self.ru_minflt + children.ru_minflt, self.ru_majflt + children.ru_majflt);
+}
+
+// Read the CPUs of a NUMA node from sysfs. Returns 0 if the node
+// doesn't exist.
+static int node_cpus(unsigned node, cpu_set_t *cpus) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return 0;
+
+    // the list looks like "0-3,8-11"
+    CPU_ZERO(cpus);
+    unsigned first, last;
+    while (fscanf(in, "%u", &first) == 1) {
+        last = first;
+        if (fscanf(in, "-%u", &last) != 1)
+            last = first;
+        for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+        if (fgetc(in) != ',')
+            break;
+    }
+    fclose(in);
+    return 1;
+}
+
+unsigned numa_num_nodes(void) {
+    cpu_set_t cpus;
+    unsigned nodes = 0;
+    while (node_cpus(nodes, &cpus))
+        nodes++;
+    return nodes > 0 ? nodes : 1;
+}
+
+void numa_configure(int enable) {
+    numa_enabled = enable && numa_num_nodes() > 1;
+}
+
+void numa_bind_worker(unsigned worker, unsigned num_workers) {
+    if (!numa_enabled || num_workers == 0)
+        return;
+    unsigned node = (unsigned) ((unsigned long) worker * numa_num_nodes() / num_workers);
+    cpu_set_t cpus;
+    if (node_cpus(node, &cpus) && CPU_COUNT(&cpus) > 0)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
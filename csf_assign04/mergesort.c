@@ -0,0 +1,267 @@
+// Parallel stable merge sort for int64_t keys, optionally carrying a
+// payload per key.
+//
+// The array is split into one contiguous chunk per thread and every
+// thread sorts its chunk. Without a payload equal keys can't be told
+// apart, so the leaf sort is used; with a payload the chunk is sorted by
+// a stable bottom-up merge sort over insertion-sorted runs. The chunks
+// are then merged pairwise, level by level, ping-ponging between the
+// array and a single scratch buffer that is allocated once up front.
+//
+// At every level each thread produces the same share of the output:
+// thread t writes positions [n * t / T, n * (t + 1) / T) of the level,
+// whatever merges they belong to. The split of a merge at an output
+// position d is found by co-ranking (merge path): a binary search for
+// the number of elements i taken from the left run so that the first d
+// outputs are a[0..i) and b[0..d-i). Even the final merge of two halves
+// therefore uses all threads. Ties are taken from the left run, so the
+// sort is stable.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parsort.h"
+
+// Below this many elements per thread, sort with one thread
+#define MERGE_SORT_MIN_PER_THREAD 4096
+
+// Runs the stable chunk sort builds with insertion sort
+#define INSERTION_RUN 32
+
+typedef struct MergeJob MergeJob;
+
+typedef struct {
+    MergeJob *job;
+    unsigned id;
+    pthread_t thread;
+} MergeWorker;
+
+struct MergeJob {
+    int64_t *keys[2];        // [0]: the array, [1]: scratch
+    uint64_t *payload[2];    // NULL without a payload
+    unsigned long n;
+    unsigned num_threads;
+    MergeWorker *workers;
+    pthread_barrier_t barrier;
+
+    // workers wait here until the pool size is final
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate_cond;
+    int gate_open;
+};
+
+static inline unsigned long chunk_start(const MergeJob *job, unsigned long c) {
+    if (c >= job->num_threads)
+        return job->n;
+    return job->n * c / job->num_threads;
+}
+
+// Number of elements of a[0..na) among the first d outputs of a stable
+// merge of a and b
+static unsigned long co_rank(const int64_t *a, unsigned long na,
+                             const int64_t *b, unsigned long nb, unsigned long d) {
+    unsigned long lo = d > nb ? d - nb : 0, hi = d < na ? d : na;
+    while (lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (a[mid] <= b[d - mid - 1])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Write outputs [begin, end) of the merge of runs [s, m) and [m, e) of
+// buffer src into the other buffer
+static void merge_part(MergeJob *job, int src, unsigned long s, unsigned long m, unsigned long e,
+                       unsigned long begin, unsigned long end) {
+    const int64_t *a = job->keys[src] + s, *b = job->keys[src] + m;
+    int64_t *out = job->keys[1 - src];
+    const uint64_t *pa = NULL, *pb = NULL;
+    uint64_t *pout = job->payload[1 - src];
+    if (pout != NULL) {
+        pa = job->payload[src] + s;
+        pb = job->payload[src] + m;
+    }
+
+    unsigned long na = m - s, nb = e - m;
+    unsigned long i = co_rank(a, na, b, nb, begin - s), j = begin - s - i;
+    unsigned long i_end = co_rank(a, na, b, nb, end - s), j_end = end - s - i_end;
+    for (unsigned long k = begin; k < end; k++) {
+        int take_a = j >= j_end || (i < i_end && a[i] <= b[j]);
+        if (take_a) {
+            if (pout != NULL)
+                pout[k] = pa[i];
+            out[k] = a[i++];
+        } else {
+            if (pout != NULL)
+                pout[k] = pb[j];
+            out[k] = b[j++];
+        }
+    }
+}
+
+static void copy_range(MergeJob *job, int from, unsigned long start, unsigned long end) {
+    memcpy(job->keys[1 - from] + start, job->keys[from] + start, (end - start) * sizeof(int64_t));
+    if (job->payload[0] != NULL)
+        memcpy(job->payload[1 - from] + start, job->payload[from] + start, (end - start) * sizeof(uint64_t));
+}
+
+// Sort keys[0][lo..hi), leaving the result in keys[0]
+static void sort_chunk(MergeJob *job, unsigned long lo, unsigned long hi) {
+    if (job->payload[0] == NULL) {
+        sort_int64(job->keys[0] + lo, hi - lo);
+        return;
+    }
+
+    int64_t *keys = job->keys[0];
+    uint64_t *payload = job->payload[0];
+    for (unsigned long s = lo; s < hi; s += INSERTION_RUN) {
+        unsigned long e = s + INSERTION_RUN < hi ? s + INSERTION_RUN : hi;
+        for (unsigned long i = s + 1; i < e; i++) {
+            int64_t key = keys[i];
+            uint64_t value = payload[i];
+            unsigned long j = i;
+            for (; j > s && keys[j - 1] > key; j--) {
+                keys[j] = keys[j - 1];
+                payload[j] = payload[j - 1];
+            }
+            keys[j] = key;
+            payload[j] = value;
+        }
+    }
+
+    int src = 0;
+    for (unsigned long width = INSERTION_RUN; width < hi - lo; width *= 2) {
+        for (unsigned long s = lo; s < hi; s += 2 * width) {
+            unsigned long m = s + width < hi ? s + width : hi;
+            unsigned long e = s + 2 * width < hi ? s + 2 * width : hi;
+            merge_part(job, src, s, m, e, s, e);
+        }
+        src = 1 - src;
+    }
+    if (src == 1)
+        copy_range(job, 1, lo, hi);
+}
+
+// This thread's share [lo, hi) of one level: runs of width chunks are
+// merged in pairs from buffer src into the other buffer
+static void merge_level(MergeJob *job, int src, unsigned long width,
+                        unsigned long lo, unsigned long hi) {
+    for (unsigned long c = 0; c < job->num_threads; c += 2 * width) {
+        unsigned long s = chunk_start(job, c);
+        unsigned long m = chunk_start(job, c + width);
+        unsigned long e = chunk_start(job, c + 2 * width);
+        if (s >= hi)
+            break;
+        if (e <= lo)
+            continue;
+        merge_part(job, src, s, m, e, s > lo ? s : lo, e < hi ? e : hi);
+    }
+}
+
+static void *merge_worker(void *arg) {
+    MergeWorker *self = arg;
+    MergeJob *job = self->job;
+
+    pthread_mutex_lock(&job->gate_lock);
+    while (!job->gate_open)
+        pthread_cond_wait(&job->gate_cond, &job->gate_lock);
+    pthread_mutex_unlock(&job->gate_lock);
+    if (self->id != 0)
+        numa_bind_worker(self->id, job->num_threads);
+
+    unsigned long lo = chunk_start(job, self->id), hi = chunk_start(job, self->id + 1);
+    sort_chunk(job, lo, hi);
+    pthread_barrier_wait(&job->barrier);
+
+    int src = 0;
+    for (unsigned long width = 1; width < job->num_threads; width *= 2) {
+        merge_level(job, src, width, lo, hi);
+        src = 1 - src;
+        pthread_barrier_wait(&job->barrier);
+    }
+    if (src == 1)
+        copy_range(job, 1, lo, hi);
+    return NULL;
+}
+
+int merge_sort_int64_payload(int64_t *arr, uint64_t *payload, unsigned long n,
+                             unsigned num_threads, const char *scratch_dir) {
+    if (num_threads < 1)
+        num_threads = 1;
+    if (n / num_threads < MERGE_SORT_MIN_PER_THREAD)
+        num_threads = n >= MERGE_SORT_MIN_PER_THREAD ? n / MERGE_SORT_MIN_PER_THREAD : 1;
+    if (n < 2)
+        return 1;
+    if (num_threads == 1 && payload == NULL) {
+        sort_int64(arr, n);
+        return 1;
+    }
+
+    MergeJob job = { .n = n, .gate_open = 0 };
+    job.keys[0] = arr;
+    job.payload[0] = payload;
+    int keys_mapped, payload_mapped = 0;
+    job.keys[1] = alloc_scratch(n, scratch_dir, &keys_mapped);
+    if (job.keys[1] == NULL)
+        return 0;
+    if (payload != NULL) {
+        job.payload[1] = (uint64_t *) alloc_scratch(n, scratch_dir, &payload_mapped);
+        if (job.payload[1] == NULL) {
+            free_scratch(job.keys[1], n, keys_mapped);
+            return 0;
+        }
+    }
+    job.workers = calloc(num_threads, sizeof(MergeWorker));
+    if (job.workers == NULL) {
+        fprintf(stderr, "Error: can't allocate merge sort workers\n");
+        free_scratch(job.keys[1], n, keys_mapped);
+        if (payload != NULL)
+            free_scratch((int64_t *) job.payload[1], n, payload_mapped);
+        return 0;
+    }
+    pthread_mutex_init(&job.gate_lock, NULL);
+    pthread_cond_init(&job.gate_cond, NULL);
+
+    // Start the helper threads; if one can't be created the sort goes
+    // ahead with the threads that exist
+    unsigned started = 1;
+    for (unsigned t = 1; t < num_threads; t++) {
+        job.workers[t].job = &job;
+        job.workers[t].id = t;
+        if (pthread_create(&job.workers[t].thread, NULL, merge_worker, &job.workers[t]) != 0) {
+            fprintf(stderr, "Warning: pthread_create failed\n");
+            break;
+        }
+        started++;
+    }
+
+    job.num_threads = started;
+    job.workers[0].job = &job;
+    job.workers[0].id = 0;
+    pthread_barrier_init(&job.barrier, NULL, started);
+
+    pthread_mutex_lock(&job.gate_lock);
+    job.gate_open = 1;
+    pthread_cond_broadcast(&job.gate_cond);
+    pthread_mutex_unlock(&job.gate_lock);
+
+    merge_worker(&job.workers[0]);
+    for (unsigned t = 1; t < started; t++)
+        pthread_join(job.workers[t].thread, NULL);
+
+    pthread_barrier_destroy(&job.barrier);
+    pthread_cond_destroy(&job.gate_cond);
+    pthread_mutex_destroy(&job.gate_lock);
+    free(job.workers);
+    free_scratch(job.keys[1], n, keys_mapped);
+    if (payload != NULL)
+        free_scratch((int64_t *) job.payload[1], n, payload_mapped);
+    return 1;
+}
+
+int merge_sort_int64(int64_t *arr, unsigned long n, unsigned num_threads, const char *scratch_dir) {
+    return merge_sort_int64_payload(arr, NULL, n, num_threads, scratch_dir);
+}
@@ -0,0 +1,166 @@
+// Sorting several files into one output (-o) and removing duplicates
+// (--unique).
+//
+// Every input file is mapped and sorted in place by the thread engine.
+// Files are claimed one at a time by up to -t sorter threads, and each
+// file gets -t / sorters worker threads, so small shards are sorted
+// side by side while a single large file still gets every thread. The
+// sorted files are then k-way merged into the output by merge_files
+// (extsort.c), which drops duplicates on the fly with --unique. The
+// output is written once and never read back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "parsort.h"
+
+typedef struct {
+    int64_t *arr;
+    unsigned long n;
+    size_t size;
+    unsigned long par_threshold;
+    unsigned long min_threshold;    // calibrated for this file, 0 disables adapting
+} InputFile;
+
+typedef struct {
+    InputFile *files;
+    unsigned num_files, threads_per_file;
+    atomic_uint next_file;
+    atomic_int failed;
+} FileJob;
+
+typedef struct {
+    FileJob *job;
+    pthread_t thread;
+} Sorter;
+
+unsigned long unique_int64(int64_t *arr, unsigned long n) {
+    if (n == 0)
+        return 0;
+    unsigned long out = 1;
+    for (unsigned long i = 1; i < n; i++)
+        if (arr[i] != arr[out - 1])
+            arr[out++] = arr[i];
+    return out;
+}
+
+static void *sorter_main(void *arg) {
+    FileJob *job = ((Sorter *) arg)->job;
+    unsigned i;
+    while ((i = atomic_fetch_add(&job->next_file, 1)) < job->num_files) {
+        InputFile *f = &job->files[i];
+        if (f->n > 1 && !quicksort_threads(f->arr, f->n, f->par_threshold, f->min_threshold,
+                                          job->threads_per_file))
+            atomic_store(&job->failed, 1);
+    }
+    return NULL;
+}
+
+// Map every input; returns 0 if one can't be opened or mapped
+static int map_inputs(const struct Options *opts, InputFile *files) {
+    for (unsigned i = 0; i < opts->num_files; i++) {
+        const char *path = opts->filenames[i];
+        int fd = open(path, O_RDWR);
+        struct stat statbuf;
+        if (fd < 0 || fstat(fd, &statbuf) != 0) {
+            fprintf(stderr, "Error: can't open file '%s'\n", path);
+            if (fd >= 0)
+                close(fd);
+            return 0;
+        }
+        files[i].size = statbuf.st_size;
+        files[i].n = files[i].size / sizeof(int64_t);
+        files[i].arr = NULL;
+        if (files[i].size > 0) {
+            files[i].arr = map_array(fd, files[i].size, opts->map_strategy);
+            if (files[i].arr == MAP_FAILED) {
+                fprintf(stderr, "Error: mmap of '%s' failed\n", path);
+                files[i].arr = NULL;
+                close(fd);
+                return 0;
+            }
+        }
+        close(fd);
+    }
+    return 1;
+}
+
+int sort_files(const struct Options *opts) {
+    // The output must not be one of the inputs, which are read while
+    // it is written
+    struct stat out_stat, in_stat;
+    if (stat(opts->output, &out_stat) == 0) {
+        for (unsigned i = 0; i < opts->num_files; i++) {
+            if (stat(opts->filenames[i], &in_stat) == 0 && in_stat.st_dev == out_stat.st_dev
+                && in_stat.st_ino == out_stat.st_ino) {
+                fprintf(stderr, "Error: the output '%s' is also an input\n", opts->output);
+                return 0;
+            }
+        }
+    }
+
+    InputFile *files = calloc(opts->num_files, sizeof(InputFile));
+    if (files == NULL)
+        return 0;
+    int ok = map_inputs(opts, files);
+
+    unsigned num_sorters = opts->num_threads < opts->num_files ? opts->num_threads : opts->num_files;
+    if (num_sorters < 1)
+        num_sorters = 1;
+    FileJob job = { .files = files, .num_files = opts->num_files };
+    job.threads_per_file = opts->num_threads / num_sorters > 0 ? opts->num_threads / num_sorters : 1;
+    atomic_init(&job.next_file, 0);
+    atomic_init(&job.failed, 0);
+
+    if (ok) {
+        // thresholds are chosen before the sorters start, so that the
+        // calibration runs don't compete with sorting; each file keeps
+        // its own minimum leaf size
+        unsigned long total = 0;
+        struct Options file_opts = *opts;
+        file_opts.engine = ENGINE_THREADS;
+        file_opts.num_threads = job.threads_per_file;
+        for (unsigned i = 0; i < opts->num_files; i++) {
+            total += files[i].n;
+            files[i].par_threshold = opts->par_threshold;
+            files[i].min_threshold = 0;
+            if (opts->auto_threshold && files[i].n > 1)
+                files[i].par_threshold = auto_par_threshold(files[i].arr, files[i].n, &file_opts,
+                                                            &files[i].min_threshold);
+        }
+        partition_configure(opts->num_threads, total);
+
+        Sorter sorters[num_sorters];
+        int started[num_sorters];
+        for (unsigned t = 0; t < num_sorters; t++)
+            sorters[t].job = &job;
+        for (unsigned t = 1; t < num_sorters; t++)
+            started[t] = pthread_create(&sorters[t].thread, NULL, sorter_main, &sorters[t]) == 0;
+        sorter_main(&sorters[0]);
+        for (unsigned t = 1; t < num_sorters; t++) {
+            if (started[t])
+                pthread_join(sorters[t].thread, NULL);
+            else
+                sorter_main(&sorters[t]);
+        }
+        ok = !atomic_load(&job.failed);
+        if (opts->verbose)
+            fprintf(stderr, "multi-file: %u files, %lu elements, %u at a time with %u threads each\n",
+                    opts->num_files, total, num_sorters, job.threads_per_file);
+    }
+
+    for (unsigned i = 0; i < opts->num_files; i++)
+        if (files[i].arr != NULL)
+            munmap(files[i].arr, files[i].size);
+    free(files);
+
+    if (!ok)
+        return 0;
+    return merge_files(opts, opts->filenames, opts->num_files, opts->output);
+}
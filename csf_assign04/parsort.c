@@ -7,11 +7,10 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
-
-int compare( const void *left, const void *right );
-void swap( int64_t *arr, unsigned long i, unsigned long j );
-unsigned long partition( int64_t *arr, unsigned long start, unsigned long end );
-int quicksort( int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold );
+#include <getopt.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "parsort.h"
 
 // TODO: declare additional helper functions if needed
 
@@ -26,20 +25,419 @@ typedef struct {
 Child quicksort_subproc(int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold);
 void quicksort_wait(Child *child);
 int quicksort_check_success(Child *child);
+
+// Process budget shared by every process of the fork engine. It lives in
+// a MAP_SHARED anonymous mapping created before the first fork, so all
+// descendants update the same counters.
+typedef struct {
+    long limit;                 // max concurrently running child processes
+    atomic_long active;         // child processes currently running
+    atomic_long peak;           // highest value active has reached
+    atomic_ulong created;       // child processes created in total
+} ForkBudget;
+
+static ForkBudget *fork_budget = NULL;
+
+// Lowest cutoff adapt_threshold may give a subtree in the fork engine,
+// set before the first fork and inherited by every child
+static unsigned long fork_min_threshold = 0;
+
+static int fork_budget_acquire(void);
+static void fork_budget_release(void);
 static int quicksort_parallel(int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold);
 
+static void usage( void ) {
+  fprintf( stderr, "Usage: parsort [options] <file> <par threshold>\n"
+                   "       parsort [options] -o <output> <file>... <par threshold>\n"
+                   "  <file> - sorts stdin to stdout in chunks of half of --memory\n"
+                   "  <par threshold> is a number of elements, or auto to derive it\n"
+                   "  from the core count, file size, and a calibration run\n"
+                   "Options:\n"
+                   "  -a, --algorithm=quick|radix|sample|merge|external|auto\n"
+                   "                             quick (default) uses the selected engine,\n"
+                   "                             radix is a parallel LSD radix sort, sample\n"
+                   "                             a parallel sample sort, merge a parallel\n"
+                   "                             stable merge sort, external a merge\n"
+                   "                             sort within --memory; auto picks external\n"
+                   "                             for files larger than memory and radix\n"
+                   "                             for other large inputs\n"
+                   "  -e, --engine=fork|threads  parallel engine for quick (default: fork)\n"
+                   "  -t, --threads=N            worker threads for the thread engine,\n"
+                   "                             radix, sample, and partitioning large\n"
+                   "                             ranges\n"
+                   "                             (default: number of cores)\n"
+                   "  -p, --max-procs=N          max concurrent child processes for the\n"
+                   "                             fork engine (default: cores - 1)\n"
+                   "  -T, --tmpdir=DIR           directory for scratch files (default: the\n"
+                   "                             directory of <file>)\n"
+                   "  -m, --memory=SIZE          buffer size for external, with an optional\n"
+                   "                             K, M, or G suffix (default: half of the\n"
+                   "                             available memory)\n"
+                   "  --map=STRATEGY[,STRATEGY]  how to map the file: plain (default),\n"
+                   "                             populate, sequential, willneed, hugepage\n"
+                   "  --numa                     bind worker threads to NUMA nodes\n"
+                   "  --type=TYPE                element type: int64 (default), uint64,\n"
+                   "                             double, int32, uint32 or float\n"
+                   "  --record-size=N            sort records of N bytes (default: 8)\n"
+                   "  --key-offset=K             offset of the int64 key in a record\n"
+                   "                             (default: 0); records are sorted by key\n"
+                   "                             indirection regardless of -a\n"
+                   "  --verify                   check that the output is sorted and has\n"
+                   "                             the same checksum as the input\n"
+                   "  --select=K|median          print the key of rank K (0-based) without\n"
+                   "                             sorting; the file is left partitioned\n"
+                   "                             around it\n"
+                   "  --top=K                    print the K smallest keys in order; the\n"
+                   "                             file is not modified\n"
+                   "  -o, --output=FILE          sort every <file> in place, then merge\n"
+                   "                             them into FILE\n"
+                   "  --unique                   remove duplicate values from the result\n"
+                   "  --trace=FILE               write a Chrome trace-event timeline of\n"
+                   "                             the quicksort engines to FILE\n"
+                   "  -v, --verbose              report engine statistics and page\n"
+                   "                             faults on stderr\n" );
+  exit( 1 );
+}
+
+// Parse a size in bytes with an optional K, M, or G suffix.
+// Returns 0 if the size is invalid.
+static unsigned long parse_size( const char *str ) {
+  char *end;
+  unsigned long size = strtoul( str, &end, 10 );
+  if ( end == str )
+    return 0;
+  switch ( *end ) {
+  case 'G': case 'g': size <<= 10; // fall through
+  case 'M': case 'm': size <<= 10; // fall through
+  case 'K': case 'k': size <<= 10; end++; break;
+  }
+  return *end == '\0' ? size : 0;
+}
+
+// Long options without a short form
+enum { OPT_MAP = 256, OPT_NUMA, OPT_RECORD_SIZE, OPT_KEY_OFFSET, OPT_VERIFY, OPT_SELECT, OPT_TOP, OPT_TRACE, OPT_UNIQUE, OPT_TYPE };
+
+// Parse command line arguments into opts, exiting with a usage
+// message if they are invalid.
+static void parse_options( int argc, char **argv, struct Options *opts ) {
+  opts->engine = ENGINE_FORK;
+  opts->algorithm = ALGO_QUICK;
+  opts->num_threads = num_cores();
+  opts->max_procs = (long) num_cores() - 1;
+  opts->verbose = 0;
+  opts->tmpdir = NULL;
+  opts->memory_budget = available_memory() / 2;
+  opts->map_strategy = 0;
+  opts->numa = 0;
+  opts->record_size = sizeof( int64_t );
+  opts->key_offset = 0;
+  opts->verify = 0;
+  opts->select = SELECT_NONE;
+  opts->select_k = 0;
+  opts->trace_path = NULL;
+  opts->output = NULL;
+  opts->unique = 0;
+  opts->key_type = KEY_INT64;
+
+  static const struct option long_opts[] = {
+    { "algorithm", required_argument, NULL, 'a' },
+    { "engine",  required_argument, NULL, 'e' },
+    { "threads", required_argument, NULL, 't' },
+    { "max-procs", required_argument, NULL, 'p' },
+    { "tmpdir", required_argument, NULL, 'T' },
+    { "memory", required_argument, NULL, 'm' },
+    { "map", required_argument, NULL, OPT_MAP },
+    { "numa", no_argument, NULL, OPT_NUMA },
+    { "record-size", required_argument, NULL, OPT_RECORD_SIZE },
+    { "key-offset", required_argument, NULL, OPT_KEY_OFFSET },
+    { "verify", no_argument, NULL, OPT_VERIFY },
+    { "select", required_argument, NULL, OPT_SELECT },
+    { "top", required_argument, NULL, OPT_TOP },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "output", required_argument, NULL, 'o' },
+    { "unique", no_argument, NULL, OPT_UNIQUE },
+    { "type", required_argument, NULL, OPT_TYPE },
+    { "verbose", no_argument, NULL, 'v' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+  while ( ( opt = getopt_long( argc, argv, "a:e:t:p:T:m:o:v", long_opts, NULL ) ) != -1 ) {
+    switch ( opt ) {
+    case 'a':
+      if ( strcmp( optarg, "quick" ) == 0 )
+        opts->algorithm = ALGO_QUICK;
+      else if ( strcmp( optarg, "radix" ) == 0 )
+        opts->algorithm = ALGO_RADIX;
+      else if ( strcmp( optarg, "sample" ) == 0 )
+        opts->algorithm = ALGO_SAMPLE;
+      else if ( strcmp( optarg, "merge" ) == 0 )
+        opts->algorithm = ALGO_MERGE;
+      else if ( strcmp( optarg, "external" ) == 0 )
+        opts->algorithm = ALGO_EXTERNAL;
+      else if ( strcmp( optarg, "auto" ) == 0 )
+        opts->algorithm = ALGO_AUTO;
+      else
+        usage();
+      break;
+    case 'e':
+      if ( strcmp( optarg, "fork" ) == 0 )
+        opts->engine = ENGINE_FORK;
+      else if ( strcmp( optarg, "threads" ) == 0 )
+        opts->engine = ENGINE_THREADS;
+      else
+        usage();
+      break;
+    case 't':
+      if ( sscanf( optarg, "%u", &opts->num_threads ) != 1 || opts->num_threads < 1 )
+        usage();
+      break;
+    case 'p':
+      if ( sscanf( optarg, "%ld", &opts->max_procs ) != 1 || opts->max_procs < 0 )
+        usage();
+      break;
+    case 'T':
+      opts->tmpdir = optarg;
+      break;
+    case 'm':
+      if ( ( opts->memory_budget = parse_size( optarg ) ) == 0 )
+        usage();
+      break;
+    case OPT_MAP:
+      if ( !parse_map_strategy( optarg, &opts->map_strategy ) )
+        usage();
+      break;
+    case OPT_NUMA:
+      opts->numa = 1;
+      break;
+    case OPT_RECORD_SIZE:
+      if ( sscanf( optarg, "%zu", &opts->record_size ) != 1 )
+        usage();
+      break;
+    case OPT_KEY_OFFSET:
+      if ( sscanf( optarg, "%zu", &opts->key_offset ) != 1 )
+        usage();
+      break;
+    case OPT_VERIFY:
+      opts->verify = 1;
+      break;
+    case OPT_SELECT:
+      opts->select = SELECT_NTH;
+      if ( strcmp( optarg, "median" ) == 0 )
+        opts->select_k = SELECT_MEDIAN;
+      else if ( sscanf( optarg, "%lu", &opts->select_k ) != 1 )
+        usage();
+      break;
+    case OPT_TOP:
+      opts->select = SELECT_TOP;
+      if ( sscanf( optarg, "%lu", &opts->select_k ) != 1 )
+        usage();
+      break;
+    case OPT_TRACE:
+      opts->trace_path = optarg;
+      break;
+    case 'o':
+      opts->output = optarg;
+      break;
+    case OPT_UNIQUE:
+      opts->unique = 1;
+      break;
+    case OPT_TYPE:
+      if ( !parse_key_type( optarg, &opts->key_type ) )
+        usage();
+      break;
+    case 'v':
+      opts->verbose = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+
+  if ( argc - optind < 2 )
+    usage();
+  const char *threshold = argv[argc - 1];
+  opts->auto_threshold = strcmp( threshold, "auto" ) == 0;
+  opts->par_threshold = 0;
+  if ( !opts->auto_threshold && sscanf( threshold, "%lu", &opts->par_threshold ) != 1 )
+    usage();
+  if ( opts->key_offset + sizeof( int64_t ) > opts->record_size ) {
+    fprintf( stderr, "Error: the key must lie within the record\n" );
+    usage();
+  }
+  opts->filename = argv[optind];
+  opts->filenames = argv + optind;
+  opts->num_files = argc - optind - 1;
+  if ( opts->num_files > 1 && opts->output == NULL ) {
+    fprintf( stderr, "Error: several input files need -o\n" );
+    usage();
+  }
+  if ( opts->output != NULL ) {
+    for ( unsigned i = 0; i < opts->num_files; i++ ) {
+      if ( strcmp( opts->filenames[i], "-" ) == 0 ) {
+        fprintf( stderr, "Error: -o needs files, not stdin\n" );
+        usage();
+      }
+    }
+  }
+  if ( ( opts->output != NULL || opts->unique )
+       && ( opts->verify || opts->record_size != sizeof( int64_t ) || opts->select != SELECT_NONE ) ) {
+    fprintf( stderr, "Error: -o and --unique don't work with --verify, --record-size, --select or --top\n" );
+    usage();
+  }
+  if ( strcmp( opts->filename, "-" ) == 0 && ( opts->verify || opts->record_size != sizeof( int64_t ) ) ) {
+    fprintf( stderr, "Error: --verify and --record-size need a file, not stdin\n" );
+    usage();
+  }
+  if ( opts->select != SELECT_NONE
+       && ( opts->verify || opts->record_size != sizeof( int64_t ) || strcmp( opts->filename, "-" ) == 0 ) ) {
+    fprintf( stderr, "Error: --select and --top need a file of plain values and no --verify\n" );
+    usage();
+  }
+  if ( opts->key_type != KEY_INT64
+       && ( opts->output != NULL || strcmp( opts->filename, "-" ) == 0
+            || opts->record_size != sizeof( int64_t ) || opts->algorithm == ALGO_EXTERNAL ) ) {
+    fprintf( stderr, "Error: --type needs one file sorted in memory (no -o, stdin, --record-size or -a external)\n" );
+    usage();
+  }
+}
+
+// Scratch files go in --tmpdir, or next to the input file so they are
+// on the same filesystem. Streams use $TMPDIR or /tmp.
+static const char *scratch_dir( const struct Options *opts, char *buf, size_t size ) {
+  if ( opts->tmpdir != NULL )
+    return opts->tmpdir;
+  if ( strcmp( opts->filename, "-" ) == 0 )
+    return getenv( "TMPDIR" ) != NULL ? getenv( "TMPDIR" ) : "/tmp";
+  snprintf( buf, size, "%s", opts->filename );
+  char *slash = strrchr( buf, '/' );
+  if ( slash == NULL )
+    return ".";
+  if ( slash == buf )
+    return "/";
+  *slash = '\0';
+  return buf;
+}
+
+// Sort arr[0..num_elements) with the algorithm and engine in opts.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+static int sort_array( int64_t *arr, unsigned long num_elements, const struct Options *opts ) {
+  enum Algorithm algorithm = opts->algorithm;
+  if ( algorithm == ALGO_AUTO ) {
+    // radix wins for large inputs as long as its scratch buffer fits in memory
+    int large = num_elements >= RADIX_MIN_ELEMENTS;
+    int fits = num_elements * sizeof(int64_t) <= available_memory();
+    algorithm = ( large && fits ) ? ALGO_RADIX : ALGO_QUICK;
+    if ( opts->verbose )
+      fprintf( stderr, "auto: using %s sort for %lu elements\n",
+               algorithm == ALGO_RADIX ? "radix" : "quick", num_elements );
+  }
+
+  if ( algorithm == ALGO_RADIX || algorithm == ALGO_SAMPLE || algorithm == ALGO_MERGE ) {
+    char dir_buf[4096];
+    const char *dir = scratch_dir( opts, dir_buf, sizeof( dir_buf ) );
+    if ( algorithm == ALGO_SAMPLE )
+      return sample_sort_int64( arr, num_elements, opts->num_threads, dir );
+    if ( algorithm == ALGO_MERGE )
+      return merge_sort_int64( arr, num_elements, opts->num_threads, dir );
+    return radix_sort_int64( arr, num_elements, opts->num_threads, dir );
+  }
+
+  partition_configure( opts->num_threads, num_elements );
+  unsigned long par_threshold = opts->par_threshold, min_threshold = 0;
+  if ( opts->auto_threshold )
+    par_threshold = auto_par_threshold( arr, num_elements, opts, &min_threshold );
+  if ( opts->engine == ENGINE_THREADS )
+    return quicksort_threads( arr, num_elements, par_threshold, min_threshold, opts->num_threads );
+
+  if ( !fork_budget_init( opts->max_procs ) ) {
+    fprintf( stderr, "Error: can't create process budget\n" );
+    return 0;
+  }
+  fork_min_threshold = min_threshold;
+  int success = quicksort( arr, 0, num_elements, par_threshold );
+  if ( opts->verbose )
+    fork_budget_report( stderr );
+  return success;
+}
+
+// Check the sorted file against the checksum taken before sorting,
+// exiting with status 1 if it isn't sorted or the records changed.
+static void verify_output( const struct Options *opts, const struct Checksum *before ) {
+  struct Checksum after;
+  int sorted = verify_file( opts, 1, &after );
+  int same = checksum_equal( before, &after );
+  if ( !same )
+    fprintf( stderr, "verify: checksum mismatch, records were lost, duplicated, or changed\n" );
+  if ( !sorted || !same )
+    exit( 1 );
+  fprintf( stderr, "verify: %lu records sorted, checksum %016llx%016llx\n", after.count,
+           (unsigned long long) after.sum1, (unsigned long long) after.sum2 );
+}
+
 int main( int argc, char **argv ) {
-  unsigned long par_threshold;
-  if ( argc != 3 || sscanf( argv[2], "%lu", &par_threshold ) != 1 ) {
-    fprintf( stderr, "Usage: parsort <file> <par threshold>\n" );
+  struct Options opts;
+  parse_options( argc, argv, &opts );
+  if ( opts.trace_path != NULL && !trace_open( opts.trace_path ) )
     exit( 1 );
+
+  // -o sorts every input and merges them into one output file
+  if ( opts.output != NULL ) {
+    if ( !sort_files( &opts ) ) {
+      fprintf( stderr, "Error: sorting failed\n" );
+      exit( 1 );
+    }
+    trace_close();
+    return 0;
   }
 
+  // "-" sorts stdin to stdout
+  if ( strcmp( opts.filename, "-" ) == 0 ) {
+    char dir_buf[4096];
+    if ( !external_sort_stream( &opts, scratch_dir( &opts, dir_buf, sizeof( dir_buf ) ),
+                                STDIN_FILENO, STDOUT_FILENO ) ) {
+      fprintf( stderr, "Error: sorting failed\n" );
+      exit( 1 );
+    }
+    trace_close();
+    return 0;
+  }
+
+  struct Checksum before;
+  if ( opts.verify && !verify_file( &opts, 0, &before ) )
+    exit( 1 );
+
+  int records = opts.record_size != sizeof( int64_t );
+
+  // Files that don't fit in memory are sorted without mapping them
+  struct stat file_stat;
+  if ( !records && opts.select == SELECT_NONE && opts.algorithm == ALGO_AUTO && opts.key_type == KEY_INT64
+       && stat( opts.filename, &file_stat ) == 0
+       && (unsigned long) file_stat.st_size > available_memory() )
+    opts.algorithm = ALGO_EXTERNAL;
+  if ( !records && opts.select == SELECT_NONE && opts.algorithm == ALGO_EXTERNAL ) {
+    char dir_buf[4096];
+    if ( !external_sort_file( &opts, scratch_dir( &opts, dir_buf, sizeof( dir_buf ) ) ) ) {
+      fprintf( stderr, "Error: sorting failed\n" );
+      exit( 1 );
+    }
+    trace_close();
+    if ( opts.verify )
+      verify_output( &opts, &before );
+    return 0;
+  }
+
+  numa_configure( opts.numa );
+  if ( opts.verbose && opts.numa )
+    fprintf( stderr, "numa: %u node(s)%s\n", numa_num_nodes(),
+             numa_num_nodes() > 1 ? "" : ", binding disabled" );
+
   int fd;
 
-  fd = open(argv[1], O_RDWR);
+  fd = open(opts.filename, O_RDWR);
   if (fd < 0) {
-    fprintf(stderr, "Error: can't open file '%s'\n", argv[1]);
+    fprintf(stderr, "Error: can't open file '%s'\n", opts.filename);
     exit(1);
   }
 
@@ -53,31 +451,99 @@ int main( int argc, char **argv ) {
     exit(1);
   }
   file_size = statbuf.st_size;
-  num_elements = file_size / sizeof(int64_t);
+  size_t element_size = key_type_size( opts.key_type );
+  num_elements = file_size / element_size;
+  if ( records && file_size % opts.record_size != 0 ) {
+    fprintf( stderr, "Error: file size is not a multiple of the record size\n" );
+    close( fd );
+    exit( 1 );
+  }
 
   // mmap the file data
   int64_t *arr;
-  arr = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  arr = map_array(fd, file_size, opts.map_strategy);
   close(fd); // file descriptor can be closed after mmap
   if (arr == MAP_FAILED) {
     fprintf(stderr, "Error: mmap failed\n");
     exit(1);
   }
 
+  // Other types are sorted as int64_t keys (see keytype.c)
+  int64_t *keys = encode_keys( arr, num_elements, &opts );
+  if ( keys == NULL )
+    exit( 1 );
+
   // Sort the data!
   int success;
-  success = quicksort( arr, 0, num_elements, par_threshold );
+  if ( opts.select != SELECT_NONE ) {
+    success = run_select( keys, num_elements, &opts );
+  } else if ( records ) {
+    char dir_buf[4096];
+    success = sort_records( (unsigned char *) arr, file_size / opts.record_size, &opts,
+                            scratch_dir( &opts, dir_buf, sizeof( dir_buf ) ) );
+  } else {
+    success = sort_array( keys, num_elements, &opts );
+  }
   if ( !success ) {
-    fprintf( stderr, "Error: sorting failed\n" );
+    decode_keys( keys, arr, num_elements, num_elements, &opts );
+    // run_select has already said what went wrong
+    if ( opts.select == SELECT_NONE )
+      fprintf( stderr, "Error: sorting failed\n" );
     exit( 1 );
   }
 
+  if ( opts.verbose )
+    report_page_faults( stderr, opts.map_strategy );
+
+  // With --unique, drop duplicates and shorten the file
+  unsigned long unique_elements = num_elements;
+  if ( opts.unique )
+    unique_elements = unique_int64( keys, num_elements );
+  decode_keys( keys, arr, unique_elements, num_elements, &opts );
+
   // Unmap the file data
   munmap(arr, file_size);
+  trace_close();
+  if ( unique_elements < num_elements && truncate( opts.filename, unique_elements * element_size ) != 0 ) {
+    fprintf( stderr, "Error: can't truncate '%s'\n", opts.filename );
+    exit( 1 );
+  }
+
+  if ( opts.verify )
+    verify_output( &opts, &before );
 
   return 0;
 }
 
+// Number of online CPU cores (at least 1).
+unsigned num_cores( void ) {
+  long n = sysconf( _SC_NPROCESSORS_ONLN );
+  return n > 0 ? (unsigned) n : 1;
+}
+
+// Bytes of physical memory that can be used without swapping: MemAvailable
+// from /proc/meminfo, which counts reclaimable page cache as well. Falls
+// back to the free pages reported by sysconf if the kernel doesn't
+// provide it.
+unsigned long available_memory( void ) {
+  FILE *meminfo = fopen( "/proc/meminfo", "r" );
+  if ( meminfo != NULL ) {
+    char line[256];
+    unsigned long kb;
+    int found = 0;
+    while ( !found && fgets( line, sizeof( line ), meminfo ) != NULL )
+      found = sscanf( line, "MemAvailable: %lu kB", &kb ) == 1;
+    fclose( meminfo );
+    if ( found )
+      return kb * 1024;
+  }
+
+  long pages = sysconf( _SC_AVPHYS_PAGES ), page_size = sysconf( _SC_PAGESIZE );
+  if ( pages < 0 || page_size < 0 )
+    return 0;
+  return (unsigned long) pages * (unsigned long) page_size;
+}
+
 // Compare elements.
 // This function can be used as a comparator for a call to qsort.
 //
@@ -111,8 +577,25 @@ void swap( int64_t *arr, unsigned long i, unsigned long j ) {
   arr[j] = tmp;
 }
 
-// Partition a region of given array from start (inclusive)
-// to end (exclusive).
+// Return the index of the median of arr[a], arr[b], and arr[c].
+static unsigned long median3( int64_t *arr, unsigned long a, unsigned long b, unsigned long c ) {
+  if ( arr[a] < arr[b] ) {
+    if ( arr[b] < arr[c] )
+      return b;
+    return ( arr[a] < arr[c] ) ? c : a;
+  } else {
+    if ( arr[a] < arr[c] )
+      return a;
+    return ( arr[b] < arr[c] ) ? c : b;
+  }
+}
+
+// Choose a pivot for a region of given array from start (inclusive)
+// to end (exclusive): the median of the first, middle, and last
+// elements for short regions, and otherwise Tukey's ninther (the
+// median of three medians of three, sampled across the region).
+// Sorted, reverse sorted, and organ-pipe inputs get a pivot near
+// the true median instead of an extreme.
 //
 // Parameters:
 //   arr - pointer to first element of array
@@ -120,54 +603,18 @@ void swap( int64_t *arr, unsigned long i, unsigned long j ) {
 //   end - exclusive upper bound index
 //
 // Return:
-//   index of the pivot element, which is globally in the correct place;
-//   all elements to the left of the pivot will have values less than
-//   the pivot element, and all elements to the right of the pivot will
-//   have values greater than or equal to the pivot
-unsigned long partition( int64_t *arr, unsigned long start, unsigned long end ) {
-  assert( end > start );
-
-  // choose the middle element as the pivot
+//   index of the chosen pivot element
+unsigned long choose_pivot( int64_t *arr, unsigned long start, unsigned long end ) {
   unsigned long len = end - start;
-  assert( len >= 2 );
-  unsigned long pivot_index = start + (len / 2);
-  int64_t pivot_val = arr[pivot_index];
-
-  // stash the pivot at the end of the sequence
-  swap( arr, pivot_index, end - 1 );
-
-  // partition all of the elements based on how they compare
-  // to the pivot element: elements less than the pivot element
-  // should be in the left partition, elements greater than or
-  // equal to the pivot should go in the right partition
-  unsigned long left_index = start,
-                right_index = start + ( len - 2 );
-
-  while ( left_index <= right_index ) {
-    // extend the left partition?
-    if ( arr[left_index] < pivot_val ) {
-      ++left_index;
-      continue;
-    }
-
-    // extend the right partition?
-    if ( arr[right_index] >= pivot_val ) {
-      --right_index;
-      continue;
-    }
+  unsigned long mid = start + ( len / 2 ), last = end - 1;
+  if ( len < 64 )
+    return median3( arr, start, mid, last );
 
-    // left_index refers to an element that should be in the right
-    // partition, and right_index refers to an element that should
-    // be in the left partition, so swap them
-    swap( arr, left_index, right_index );
-  }
-
-  // at this point, left_index points to the first element
-  // in the right partition, so place the pivot element there
-  // and return the left index, since that's where the pivot
-  // element is now
-  swap( arr, left_index, end - 1 );
-  return left_index;
+  unsigned long step = len / 8;
+  unsigned long a = median3( arr, start, start + step, start + 2 * step );
+  unsigned long b = median3( arr, mid - step, mid, mid + step );
+  unsigned long c = median3( arr, last - 2 * step, last - step, last );
+  return median3( arr, a, b, c );
 }
 
 // Sort specified region of array.
@@ -195,7 +642,10 @@ int quicksort(int64_t *arr, unsigned long start, unsigned long end, unsigned lon
 
     // Sequential sort if below threshold
     if (len <= par_threshold) {
-        qsort(arr + start, len, sizeof(int64_t), compare);
+        TraceSpan span;
+        trace_begin(&span);
+        sort_int64(arr + start, len);
+        trace_end(&span, "sort", start, end);
         return 1;
     } else {
         //recursive case: parallel quicksort
@@ -215,6 +665,7 @@ Child quicksort_subproc(int64_t *arr, unsigned long start, unsigned long end, un
     }
     if (pid == 0) {
         // Child process — perform recursive sort
+        trace_name("process_name", "child %d [%lu, %lu)", (int) getpid(), start, end);
         int success = quicksort(arr, start, end, par_threshold);
         exit(success ? 0 : 1);
     }
@@ -245,25 +696,97 @@ void quicksort_wait(Child *child) {
     child->waited = 1;
 }
 
-//Create Child Process to do recursive sortingif size > threshold
-static int quicksort_parallel(int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold) {
-    unsigned long mid = partition(arr, start, end);
-
-    Child left = quicksort_subproc(arr, start, mid, par_threshold);
-    Child right = quicksort_subproc(arr, mid + 1, end, par_threshold);
-    
-    // Check if both children were created successfully
-    if (!left.valid || !right.valid) {
-        // Fork failed - wait for any successfully created children
-        if (left.valid) quicksort_wait(&left);
-        if (right.valid) quicksort_wait(&right);
+// Create the shared process budget for the fork engine.
+// Returns 1 on success, 0 if the shared mapping can't be created.
+int fork_budget_init(long max_procs) {
+    void *mem = mmap(NULL, sizeof(ForkBudget), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
         return 0;
+    fork_budget = mem;
+    fork_budget->limit = max_procs;
+    atomic_init(&fork_budget->active, 0);
+    atomic_init(&fork_budget->peak, 0);
+    atomic_init(&fork_budget->created, 0);
+    return 1;
+}
+
+// Print how many processes the fork engine used.
+void fork_budget_report(FILE *out) {
+    if (fork_budget == NULL)
+        return;
+    fprintf(out, "fork engine: %lu child processes created, peak %ld concurrent (limit %ld)\n",
+            atomic_load(&fork_budget->created), atomic_load(&fork_budget->peak),
+            fork_budget->limit);
+}
+
+// Reserve a slot for one more child process.
+// Returns 1 if a child may be created, 0 if the budget is exhausted.
+// Without a budget (fork_budget_init not called) children are unbounded.
+static int fork_budget_acquire(void) {
+    if (fork_budget == NULL)
+        return 1;
+    long active = atomic_load(&fork_budget->active);
+    do {
+        if (active >= fork_budget->limit)
+            return 0;
+    } while (!atomic_compare_exchange_weak(&fork_budget->active, &active, active + 1));
+
+    long peak = atomic_load(&fork_budget->peak);
+    while (active + 1 > peak && !atomic_compare_exchange_weak(&fork_budget->peak, &peak, active + 1))
+        ;
+    atomic_fetch_add(&fork_budget->created, 1);
+    return 1;
+}
+
+// Give back a slot once its child process has been waited for.
+static void fork_budget_release(void) {
+    if (fork_budget != NULL)
+        atomic_fetch_sub(&fork_budget->active, 1);
+}
+
+// Partition, then sort the left side in a child process if the budget
+// allows it while this process sorts the right side. When the budget
+// is exhausted both sides are sorted by recursion in this process.
+// With an automatic threshold each side gets its own cutoff.
+static int quicksort_parallel(int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold) {
+    unsigned long eq_start, eq_end;
+    TraceSpan span;
+    trace_begin(&span);
+    partition_range(arr, start, end, &eq_start, &eq_end);
+    trace_end_partition(&span, start, end, eq_start, eq_end);
+    unsigned long left_threshold = adapt_threshold(par_threshold, fork_min_threshold,
+                                                   eq_start - start, end - eq_end);
+    unsigned long right_threshold = adapt_threshold(par_threshold, fork_min_threshold,
+                                                    end - eq_end, eq_start - start);
+
+    Child left = { .pid = -1, .waited = 0, .success = 0, .valid = 0 };
+    int forked = fork_budget_acquire();
+    if (forked) {
+        trace_begin(&span);
+        left = quicksort_subproc(arr, start, eq_start, left_threshold);
+        trace_end(&span, "fork", start, eq_start);
+        if (!left.valid) {
+            // Fork failed
+            fork_budget_release();
+            return 0;
+        }
+    }
+
+    int right_success = quicksort(arr, eq_end, end, right_threshold);
+
+    int left_success;
+    if (forked) {
+        // Wait for the child process to finish and verify success
+        trace_begin(&span);
+        quicksort_wait(&left);
+        trace_end(&span, "wait", start, eq_start);
+        fork_budget_release();
+        left_success = left.success;
+    } else {
+        left_success = quicksort(arr, start, eq_start, left_threshold);
     }
-    
-    // Wait for both child processes to finish and verify success
-    quicksort_wait(&left);
-    quicksort_wait(&right);
-    
+
     // Return 1 only if both left and right sides sorted successfully
-    return left.success && right.success;
+    return left_success && right_success;
 }
@@ -0,0 +1,397 @@
+#ifndef PARSORT_H
+#define PARSORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Mechanism used to run the parallel quicksort
+enum Engine {
+  ENGINE_FORK,     // child processes sharing a MAP_SHARED mapping
+  ENGINE_THREADS   // fixed pool of pthreads with work-stealing deques
+};
+
+// Sorting algorithm
+enum Algorithm {
+  ALGO_QUICK,      // parallel quicksort on the selected engine
+  ALGO_RADIX,      // parallel LSD radix sort
+  ALGO_SAMPLE,     // parallel sample sort into a few buckets per thread
+  ALGO_MERGE,      // parallel stable merge sort
+  ALGO_EXTERNAL,   // external merge sort within a memory budget
+  ALGO_AUTO        // external for files larger than memory, radix for
+                   // large inputs that fit, else quick
+};
+
+// Query answered instead of sorting (see select.c)
+enum Select {
+  SELECT_NONE,     // sort the file
+  SELECT_NTH,      // --select: print the key of rank select_k
+  SELECT_TOP       // --top: print the select_k smallest keys
+};
+
+// Element types (--type); all are sorted as int64_t keys, see keytype.c
+enum KeyType {
+  KEY_INT64,       // the default
+  KEY_UINT64,
+  KEY_DOUBLE,
+  KEY_INT32,
+  KEY_UINT32,
+  KEY_FLOAT
+};
+
+// select_k value for the median, rank (n - 1) / 2
+#define SELECT_MEDIAN ( ~0UL )
+
+// Inputs with at least this many elements use radix sort under ALGO_AUTO
+#define RADIX_MIN_ELEMENTS ( 1UL << 16 )
+
+// Mapping strategy flags for the input file (see mapping.c)
+#define MAPPING_POPULATE   0x1   // MAP_POPULATE: fault in every page up front
+#define MAPPING_SEQUENTIAL 0x2   // MADV_SEQUENTIAL on the whole mapping
+#define MAPPING_WILLNEED   0x4   // MADV_WILLNEED on ranges before partitioning
+#define MAPPING_HUGEPAGE   0x8   // MADV_HUGEPAGE on the whole mapping
+
+// Command line options
+struct Options {
+  enum Engine engine;
+  enum Algorithm algorithm;
+  unsigned num_threads;
+  long max_procs;
+  int verbose;
+  const char *tmpdir;          // NULL: directory of the input file
+  unsigned long memory_budget; // bytes of buffer for ALGO_EXTERNAL
+  unsigned map_strategy;       // MAPPING_* flags
+  size_t record_size;          // bytes per record (8: plain int64_t values)
+  size_t key_offset;           // byte offset of the int64_t key in a record
+  int verify;                  // check the output and compare checksums
+  int numa;                    // bind workers to NUMA nodes
+  enum Select select;
+  unsigned long select_k;      // rank for SELECT_NTH, count for SELECT_TOP
+  const char *trace_path;      // Chrome trace output, or NULL
+  const char *output;          // -o: merge all inputs into this file
+  enum KeyType key_type;       // type of the elements of the file
+  int unique;                  // drop duplicate values
+  unsigned long par_threshold;
+  int auto_threshold;          // par_threshold given as "auto"
+  const char *filename;         // the first input
+  char **filenames;            // all inputs
+  unsigned num_files;
+};
+
+int compare( const void *left, const void *right );
+void swap( int64_t *arr, unsigned long i, unsigned long j );
+unsigned long choose_pivot( int64_t *arr, unsigned long start, unsigned long end );
+int quicksort( int64_t *arr, unsigned long start, unsigned long end, unsigned long par_threshold );
+
+// Ranges with at least this many elements are partitioned by several
+// threads (see ppartition.c)
+#define PARALLEL_PARTITION_MIN (1UL << 22)
+
+// Set the number of threads and the total number of elements that
+// partition_range divides threads by. Before this is called every
+// range is partitioned sequentially.
+void partition_configure( unsigned num_threads, unsigned long total );
+
+// Three-way partition of arr[start, end) around a pivot picked by
+// choose_pivot, using multiple threads for large ranges (defined in
+// ppartition.c). Two partition_split passes move the elements less
+// than the pivot first, then those equal to it. On return,
+// [start, eq_start) is less than the pivot, [eq_start, eq_end) equal
+// to it (never empty), and [eq_end, end) greater.
+void partition_range( int64_t *arr, unsigned long start, unsigned long end,
+                      unsigned long *eq_start, unsigned long *eq_end );
+
+// Two-way partition kernels (defined in partkernel.c)
+enum PartitionKernel {
+  PARTITION_SCALAR,   // branchless Lomuto, the reference
+  PARTITION_BLOCK,    // BlockQuicksort offset buffers
+  PARTITION_AVX2,
+  PARTITION_AVX512,
+};
+
+// Reorder arr[0..n) so that the elements below pivot (at most pivot if
+// equal_left is set) come first, using the kernel chosen at startup:
+// the widest vector kernel the CPU supports, or else the block kernel.
+//
+// Return:
+//   the number of elements that went first
+unsigned long partition_split( int64_t *arr, unsigned long n, int64_t pivot, int equal_left );
+
+// Whether kernel can run on this CPU.
+int partition_kernel_available( enum PartitionKernel kernel );
+
+// Make partition_split use kernel, if it is available.
+//
+// Return:
+//   1 on success, 0 (leaving the kernel unchanged) if it isn't available
+int partition_kernel_use( enum PartitionKernel kernel );
+
+// The kernel partition_split uses, and the name of a kernel.
+enum PartitionKernel partition_kernel_current( void );
+const char *partition_kernel_name( enum PartitionKernel kernel );
+
+// Bound the fork engine to at most max_procs concurrently running child
+// processes; ranges that can't get a child are sorted in-process.
+// Returns 1 on success, 0 if the shared budget can't be created.
+int fork_budget_init( long max_procs );
+
+// Print how many child processes the fork engine created.
+void fork_budget_report( FILE *out );
+
+// Sort arr[0..n) sequentially: an int64_t-specialized introsort with
+// branchless partitioning (defined in leafsort.c). Used for the leaves
+// of every engine.
+void sort_int64( int64_t *arr, unsigned long n );
+
+// Whether the CPU supports the AVX2 small-block sorting network.
+int sort_int64_simd_available( void );
+
+// Enable (if supported) or disable the AVX2 small-block sort.
+// It is enabled by default.
+void sort_int64_use_simd( int enable );
+
+// Sort arr[0..n) with a parallel LSD radix sort (defined in radix.c).
+// Scratch space comes from memory if it fits, otherwise from an
+// unlinked temporary file in scratch_dir.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int radix_sort_int64( int64_t *arr, unsigned long n, unsigned num_threads,
+                      const char *scratch_dir );
+
+// Like radix_sort_int64, but payload[i] moves together with arr[i].
+// The sort is stable.
+int radix_sort_int64_payload( int64_t *arr, uint64_t *payload, unsigned long n,
+                              unsigned num_threads, const char *scratch_dir );
+
+// Choose par_threshold for sorting arr[0..n) from the core count, n, and
+// a calibration run of the leaf sort on a sample of arr (defined in
+// autotune.c). *min_threshold is set to the smallest leaf worth handing
+// to another worker, which enables per-subtree adaptation for this
+// array, or to 0 if splitting gains nothing.
+unsigned long auto_par_threshold( const int64_t *arr, unsigned long n, const struct Options *opts,
+                                  unsigned long *min_threshold );
+
+// Cutoff for one side of a partition: side and other are the sizes of
+// the two sides. If min_threshold is nonzero, the larger side of a badly
+// unbalanced split gets a lower cutoff, but not below min_threshold;
+// otherwise threshold is returned.
+unsigned long adapt_threshold( unsigned long threshold, unsigned long min_threshold,
+                               unsigned long side, unsigned long other );
+
+// Answer opts->select for arr[0..n) and print the result on stdout
+// (defined in select.c). SELECT_NTH leaves arr partitioned around the
+// selected rank; SELECT_TOP doesn't modify arr.
+//
+// Return:
+//   1 if successful, 0 otherwise (after printing why on stderr)
+int run_select( int64_t *arr, unsigned long n, const struct Options *opts );
+
+// Timeline tracing (defined in trace.c). Until trace_open succeeds all
+// trace functions do nothing.
+typedef struct {
+  double start;          // microseconds
+  long minflt, majflt;   // page faults of the thread at the start
+} TraceSpan;
+
+// Create the trace file; returns 0 on failure. trace_close writes the
+// end of the JSON array and must be called by the top-level process.
+int trace_open( const char *path );
+void trace_close( void );
+
+// Write this thread's buffered events; done at exit automatically.
+void trace_flush( void );
+
+// Name the current process or thread: kind is "process_name" or
+// "thread_name".
+void trace_name( const char *kind, const char *fmt, ... );
+
+// Record an event named name covering [start, end) of the array from
+// trace_begin to trace_end. trace_end_partition records a partition and
+// its skew.
+void trace_begin( TraceSpan *span );
+void trace_end( const TraceSpan *span, const char *name, unsigned long start, unsigned long end );
+void trace_end_partition( const TraceSpan *span, unsigned long start, unsigned long end,
+                          unsigned long eq_start, unsigned long eq_end );
+
+// Sort every file in opts->filenames in place with the thread engine,
+// several at a time, then merge them into opts->output (defined in
+// multifile.c).
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int sort_files( const struct Options *opts );
+
+// K-way merge of the sorted files paths[0..num_files) into output with
+// a loser tree (defined in extsort.c), dropping duplicates if
+// opts->unique is set.
+//
+// Return:
+//   1 if the merge was successful, 0 otherwise
+int merge_files( const struct Options *opts, char *const *paths, unsigned num_files, const char *output );
+
+// Move the distinct values of the sorted arr[0..n) to its front and
+// return how many there are.
+unsigned long unique_int64( int64_t *arr, unsigned long n );
+
+// Parse a --type name.
+//
+// Return:
+//   1 if name is a known type (stored in *type), 0 otherwise
+int parse_key_type( const char *name, enum KeyType *type );
+
+// Name and size in bytes of an element of a type.
+const char *key_type_name( enum KeyType type );
+size_t key_type_size( enum KeyType type );
+
+// Encode the n elements of opts->key_type at data as int64_t keys in
+// the same order (defined in keytype.c), using opts->num_threads
+// threads. 8-byte types are encoded in place; 4-byte types into a new
+// buffer that fork children share.
+//
+// Return:
+//   the keys (data itself for int64), or NULL if there is no memory
+int64_t *encode_keys( void *data, unsigned long n, const struct Options *opts );
+
+// Decode keys[0..count) back into data and release the buffer of n keys
+// that encode_keys allocated, if any.
+void decode_keys( int64_t *keys, void *data, unsigned long count, unsigned long n,
+                  const struct Options *opts );
+
+// The key of the element of a type at elt.
+int64_t key_load( const void *elt, enum KeyType type );
+
+// Print the element with key on its own line.
+void print_key( FILE *out, int64_t key, enum KeyType type );
+
+// Order-independent checksum of the multiset of records in a file
+struct Checksum {
+  unsigned long count;
+  uint64_t sum1, sum2;         // sums of two different hashes of each record
+};
+
+// Scan opts->filename in parallel (defined in verify.c): compute the
+// checksum of its records and, if check_order is set, check that their
+// keys never decrease, including across chunk boundaries.
+//
+// Return:
+//   1 if the scan succeeded (and the file is sorted, if checked),
+//   0 otherwise; problems are reported on stderr
+int verify_file( const struct Options *opts, int check_order, struct Checksum *checksum );
+
+// Whether two checksums describe the same multiset.
+int checksum_equal( const struct Checksum *a, const struct Checksum *b );
+
+// Sort num_records records of opts->record_size bytes at data by the
+// int64_t key at opts->key_offset in each record (defined in records.c).
+// Keys and record indices are sorted instead of the records, which are
+// then moved once by a parallel permutation pass. Records with equal
+// keys keep their order.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int sort_records( unsigned char *data, unsigned long num_records,
+                  const struct Options *opts, const char *scratch_dir );
+
+// Sort arr[0..n) with a parallel sample sort (defined in samplesort.c):
+// splitters from a random sample divide the keys into buckets, the
+// threads scatter their chunks into contiguous bucket regions of a
+// scratch buffer, and then sort the buckets independently.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int sample_sort_int64( int64_t *arr, unsigned long n, unsigned num_threads,
+                       const char *scratch_dir );
+
+// Sort arr[0..n) with a parallel stable merge sort on num_threads
+// threads (defined in mergesort.c). Every thread sorts one chunk, then
+// the chunks are merged pairwise with each merge split among all
+// threads by co-ranking. One scratch buffer of n elements is allocated
+// up front, in memory or in a temporary file in scratch_dir.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int merge_sort_int64( int64_t *arr, unsigned long n, unsigned num_threads,
+                      const char *scratch_dir );
+
+// Like merge_sort_int64, but payload[i] moves together with arr[i], and
+// elements with equal keys keep their order.
+int merge_sort_int64_payload( int64_t *arr, uint64_t *payload, unsigned long n,
+                              unsigned num_threads, const char *scratch_dir );
+
+// Parse a comma-separated list of mapping strategies (plain, populate,
+// sequential, willneed, hugepage) into MAPPING_* flags (defined in
+// mapping.c). Returns 0 if a name is unknown.
+int parse_map_strategy( const char *str, unsigned *strategy );
+
+// Map size bytes of fd MAP_SHARED using the given MAPPING_* flags.
+// Returns MAP_FAILED on failure.
+int64_t *map_array( int fd, size_t size, unsigned strategy );
+
+// Ask the kernel to read arr[start, end) ahead if the mapping uses
+// MAPPING_WILLNEED; does nothing otherwise.
+void prefetch_range( int64_t *arr, unsigned long start, unsigned long end );
+
+// Print the mapping strategy and the page faults of this process and
+// its waited-for children.
+void report_page_faults( FILE *out, unsigned strategy );
+
+// Number of NUMA nodes (at least 1).
+unsigned numa_num_nodes( void );
+
+// Enable or disable binding workers to NUMA nodes. Binding stays off on
+// single-node hosts.
+void numa_configure( int enable );
+
+// Pin the calling thread, worker number worker of num_workers, to the
+// CPUs of node worker * nodes / num_workers if binding is enabled.
+void numa_bind_worker( unsigned worker, unsigned num_workers );
+
+// Sort the file opts->filename with an external merge sort (defined in
+// extsort.c): runs of opts->memory_budget bytes are sorted in memory by
+// the thread engine and written to an unlinked temporary file in
+// scratch_dir, then merged back into the file with a loser tree.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int external_sort_file( const struct Options *opts, const char *scratch_dir );
+
+// Sort the int64_t values read from in_fd, which may be a pipe, and
+// write them to out_fd (defined in extsort.c). Chunks of half of
+// opts->memory_budget are sorted and spilled to a run file in
+// scratch_dir while the next chunk is read, then merged to out_fd.
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int external_sort_stream( const struct Options *opts, const char *scratch_dir, int in_fd, int out_fd );
+
+// Allocate scratch space for n elements (defined in radix.c): memory if
+// it fits in what is currently available, otherwise an unlinked
+// temporary file in scratch_dir. Returns NULL on failure; *is_mapped
+// tells free_scratch how to release it.
+int64_t *alloc_scratch( unsigned long n, const char *scratch_dir, int *is_mapped );
+void free_scratch( int64_t *scratch, unsigned long n, int is_mapped );
+
+// Bytes of physical memory that can be used without swapping.
+unsigned long available_memory( void );
+
+// Number of online CPU cores (at least 1).
+unsigned num_cores( void );
+
+// Sort arr[0..num_elements) in place with the thread engine
+// (defined in thread_engine.c).
+//
+// Parameters:
+//   arr - pointer to first element of array
+//   num_elements - number of elements to sort
+//   par_threshold - ranges with at most this many elements are
+//                   sorted sequentially by a single worker
+//   min_threshold - lowest cutoff adapt_threshold may give a subtree
+//                   (from auto_par_threshold); 0 keeps par_threshold
+//   num_threads - number of worker threads (including the caller)
+//
+// Return:
+//   1 if the sort was successful, 0 otherwise
+int quicksort_threads( int64_t *arr, unsigned long num_elements, unsigned long par_threshold,
+                       unsigned long min_threshold, unsigned num_threads );
+
+#endif // PARSORT_H
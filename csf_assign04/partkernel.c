@@ -0,0 +1,358 @@
+// Two-way partition kernels: reorder an array so that the elements
+// below a pivot come first.
+//
+// scalar   the branchless Lomuto loop that the rest of parsort used
+//          before; it is the reference the other kernels are checked
+//          against (see bench_partition.c).
+// block    BlockQuicksort: the comparisons for a block of BLOCK
+//          elements at each end are turned into offset buffers without
+//          branching on their results, then the misplaced elements
+//          are exchanged between the two buffers with one cyclic
+//          permutation, so each is read and written once. The only
+//          branches left depend on loop counters.
+// avx2     in-place vector partition, 4 keys per compare. The keys are
+//          permuted so that those below the pivot come first, with a
+//          table indexed by the compare mask, and the vector is stored
+//          at both ends; each end keeps only its own keys.
+// avx512   the same with 8 keys per compare, using vpcompressq and
+//          masked stores.
+//
+// The vector kernels load the first and last VECTOR_UNROLL vectors up
+// front, which leaves a gap of free space at each end. The next
+// VECTOR_UNROLL vectors are always read from the end with the smaller
+// gap, so both gaps are large enough for whatever they write. The last
+// few keys and the saved vectors are written into the gap that remains
+// in the middle.
+//
+// The fastest kernel the CPU supports is chosen at startup; without
+// AVX2 that is block, which partitions about 1.1x as fast as scalar.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "parsort.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Elements per block of the block kernel (offsets must fit a byte)
+#define BLOCK 128
+
+// Vectors the vector kernels read from one end at a time (the main
+// loops are unrolled by hand to match)
+#define VECTOR_UNROLL 4
+
+typedef unsigned long (*SplitFn)(int64_t *arr, unsigned long n, int64_t pivot);
+
+static inline void swap_elts(int64_t *arr, unsigned long i, unsigned long j) {
+    int64_t tmp = arr[i];
+    arr[i] = arr[j];
+    arr[j] = tmp;
+}
+
+// All kernels below split by x < pivot
+static unsigned long split_scalar(int64_t *arr, unsigned long n, int64_t pivot) {
+    unsigned long store = 0;
+    for (unsigned long i = 0; i < n; i++) {
+        int64_t x = arr[i];
+        arr[i] = arr[store];
+        arr[store] = x;
+        store += x < pivot;
+    }
+    return store;
+}
+
+static unsigned long split_block(int64_t *arr, unsigned long n, int64_t pivot) {
+    unsigned char offsets_l[BLOCK], offsets_r[BLOCK];
+    unsigned start_l = 0, num_l = 0, start_r = 0, num_r = 0;
+
+    // [0, l) is below the pivot and [r, n) is not
+    unsigned long l = 0, r = n;
+    while (r - l > 2 * BLOCK) {
+        if (num_l == 0) {
+            start_l = 0;
+            const int64_t *block = arr + l;
+            for (unsigned i = 0; i < BLOCK; i += 4) {
+                offsets_l[num_l] = i;
+                num_l += block[i] >= pivot;
+                offsets_l[num_l] = i + 1;
+                num_l += block[i + 1] >= pivot;
+                offsets_l[num_l] = i + 2;
+                num_l += block[i + 2] >= pivot;
+                offsets_l[num_l] = i + 3;
+                num_l += block[i + 3] >= pivot;
+            }
+        }
+        if (num_r == 0) {
+            start_r = 0;
+            const int64_t *block = arr + r - 1;
+            for (unsigned i = 0; i < BLOCK; i += 4) {
+                offsets_r[num_r] = i;
+                num_r += *(block - i) < pivot;
+                offsets_r[num_r] = i + 1;
+                num_r += *(block - i - 1) < pivot;
+                offsets_r[num_r] = i + 2;
+                num_r += *(block - i - 2) < pivot;
+                offsets_r[num_r] = i + 3;
+                num_r += *(block - i - 3) < pivot;
+            }
+        }
+        unsigned num = num_l < num_r ? num_l : num_r;
+        if (num > 0) {
+            // one cyclic permutation instead of num swaps: each element
+            // is read and written once
+            int64_t *left = arr + l, *right = arr + r - 1;
+            const unsigned char *ol = offsets_l + start_l, *or = offsets_r + start_r;
+            int64_t tmp = left[ol[0]];
+            left[ol[0]] = right[-(long) or[0]];
+            for (unsigned j = 1; j < num; j++) {
+                right[-(long) or[j - 1]] = left[ol[j]];
+                left[ol[j]] = right[-(long) or[j]];
+            }
+            right[-(long) or[num - 1]] = tmp;
+        }
+        num_l -= num;
+        num_r -= num;
+        start_l += num;
+        start_r += num;
+        if (num_l == 0)
+            l += BLOCK;
+        if (num_r == 0)
+            r -= BLOCK;
+    }
+    // at most two blocks are left, possibly partly done
+    return l + split_scalar(arr + l, r - l, pivot);
+}
+
+#if defined(__x86_64__)
+
+#define AVX2_FN __attribute__((target("avx2,popcnt")))
+#define AVX512_FN __attribute__((target("avx512f,popcnt")))
+
+// perm_table[m] moves the lanes set in the 4-bit mask m to the front, as
+// 32-bit indices for vpermd; store_masks[k] enables the first k lanes
+static int32_t perm_table[16][8] __attribute__((aligned(32)));
+static int64_t store_masks[5][4] __attribute__((aligned(32)));
+
+static void init_avx2_tables(void) {
+    for (unsigned m = 0; m < 16; m++) {
+        unsigned k = 0;
+        for (unsigned lane = 0; lane < 4; lane++) {
+            if (m & (1u << lane)) {
+                perm_table[m][2 * k] = 2 * lane;
+                perm_table[m][2 * k + 1] = 2 * lane + 1;
+                k++;
+            }
+        }
+        for (unsigned lane = 0; lane < 4; lane++) {
+            if (!(m & (1u << lane))) {
+                perm_table[m][2 * k] = 2 * lane;
+                perm_table[m][2 * k + 1] = 2 * lane + 1;
+                k++;
+            }
+        }
+    }
+    for (unsigned k = 0; k <= 4; k++)
+        for (unsigned lane = 0; lane < 4; lane++)
+            store_masks[k][lane] = lane < k ? -1 : 0;
+}
+
+// Write the keys of v below the pivot at *store_l and the rest just
+// before *store_r. Both ends must have room for a whole vector: the
+// permuted vector, with the keys below the pivot first, is stored at
+// both, and the lanes that don't belong there land in free space.
+static inline AVX2_FN void store_avx2(int64_t *arr, __m256i v, __m256i pv,
+                                      unsigned long *store_l, unsigned long *store_r) {
+    unsigned less = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(pv, v)));
+    unsigned num_l = __builtin_popcount(less);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_load_si256((const __m256i *) perm_table[less]));
+    _mm256_storeu_si256((__m256i *) (arr + *store_l), v);
+    _mm256_storeu_si256((__m256i *) (arr + *store_r - 4), v);
+    *store_l += num_l;
+    *store_r -= 4 - num_l;
+}
+
+// Position of the next count keys to read, from the end with less free
+// space. The branch is often mispredicted, but when it is predicted the
+// loads don't have to wait for the stores before them; a branchless
+// select makes every block wait and is slower.
+static inline unsigned long next_read(unsigned long *read_l, unsigned long *read_r,
+                                      unsigned long store_l, unsigned long store_r,
+                                      unsigned long count) {
+    if (*read_l - store_l < store_r - *read_r) {
+        *read_l += count;
+        return *read_l - count;
+    }
+    *read_r -= count;
+    return *read_r;
+}
+
+static AVX2_FN unsigned long split_avx2(int64_t *arr, unsigned long n, int64_t pivot) {
+    if (n < 2 * VECTOR_UNROLL * 4)
+        return split_scalar(arr, n, pivot);
+    __m256i pv = _mm256_set1_epi64x(pivot);
+    __m256i saved[2 * VECTOR_UNROLL];
+    for (unsigned i = 0; i < VECTOR_UNROLL; i++) {
+        saved[i] = _mm256_loadu_si256((const __m256i *) (arr + 4 * i));
+        saved[VECTOR_UNROLL + i] = _mm256_loadu_si256((const __m256i *) (arr + n - 4 * (i + 1)));
+    }
+    unsigned long read_l = VECTOR_UNROLL * 4, read_r = n - VECTOR_UNROLL * 4;
+    unsigned long store_l = 0, store_r = n;
+
+    while (read_r - read_l >= VECTOR_UNROLL * 4) {
+        unsigned long pos = next_read(&read_l, &read_r, store_l, store_r, VECTOR_UNROLL * 4);
+        // all four are loaded before storing, which may overwrite them
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) (arr + pos));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (arr + pos + 4));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *) (arr + pos + 8));
+        __m256i v3 = _mm256_loadu_si256((const __m256i *) (arr + pos + 12));
+        store_avx2(arr, v0, pv, &store_l, &store_r);
+        store_avx2(arr, v1, pv, &store_l, &store_r);
+        store_avx2(arr, v2, pv, &store_l, &store_r);
+        store_avx2(arr, v3, pv, &store_l, &store_r);
+    }
+    while (read_r - read_l >= 4) {
+        unsigned long pos = next_read(&read_l, &read_r, store_l, store_r, 4);
+        store_avx2(arr, _mm256_loadu_si256((const __m256i *) (arr + pos)), pv, &store_l, &store_r);
+    }
+
+    // Everything in [store_l, store_r) is free once the last few keys
+    // are copied out. They are placed first, so that the free space is
+    // a whole number of vectors for the saved ones.
+    int64_t rest[3];
+    unsigned num_rest = read_r - read_l;
+    for (unsigned i = 0; i < num_rest; i++)
+        rest[i] = arr[read_l + i];
+    for (unsigned i = 0; i < num_rest; i++) {
+        if (rest[i] < pivot)
+            arr[store_l++] = rest[i];
+        else
+            arr[--store_r] = rest[i];
+    }
+    for (unsigned i = 0; i < 2 * VECTOR_UNROLL; i++)
+        store_avx2(arr, saved[i], pv, &store_l, &store_r);
+    return store_l;
+}
+
+// Like store_avx2 for the lanes of v enabled in valid; masked stores
+// write only the keys, so any amount of free space will do
+static inline AVX512_FN void store_avx512(int64_t *arr, __m512i v, __m512i pv, __mmask8 valid,
+                                          unsigned long *store_l, unsigned long *store_r) {
+    __mmask8 less = _mm512_mask_cmplt_epi64_mask(valid, v, pv);
+    __mmask8 more = valid & ~less;
+    unsigned num_l = __builtin_popcount(less), num_r = __builtin_popcount(more);
+    _mm512_mask_storeu_epi64(arr + *store_l, (__mmask8) ((1u << num_l) - 1),
+                             _mm512_maskz_compress_epi64(less, v));
+    *store_l += num_l;
+    *store_r -= num_r;
+    _mm512_mask_storeu_epi64(arr + *store_r, (__mmask8) ((1u << num_r) - 1),
+                             _mm512_maskz_compress_epi64(more, v));
+}
+
+static AVX512_FN unsigned long split_avx512(int64_t *arr, unsigned long n, int64_t pivot) {
+    if (n < 2 * VECTOR_UNROLL * 8)
+        return split_scalar(arr, n, pivot);
+    __m512i pv = _mm512_set1_epi64(pivot);
+    __m512i saved[2 * VECTOR_UNROLL];
+    for (unsigned i = 0; i < VECTOR_UNROLL; i++) {
+        saved[i] = _mm512_loadu_si512(arr + 8 * i);
+        saved[VECTOR_UNROLL + i] = _mm512_loadu_si512(arr + n - 8 * (i + 1));
+    }
+    unsigned long read_l = VECTOR_UNROLL * 8, read_r = n - VECTOR_UNROLL * 8;
+    unsigned long store_l = 0, store_r = n;
+
+    while (read_r - read_l >= VECTOR_UNROLL * 8) {
+        unsigned long pos = next_read(&read_l, &read_r, store_l, store_r, VECTOR_UNROLL * 8);
+        __m512i v0 = _mm512_loadu_si512(arr + pos);
+        __m512i v1 = _mm512_loadu_si512(arr + pos + 8);
+        __m512i v2 = _mm512_loadu_si512(arr + pos + 16);
+        __m512i v3 = _mm512_loadu_si512(arr + pos + 24);
+        store_avx512(arr, v0, pv, 0xFF, &store_l, &store_r);
+        store_avx512(arr, v1, pv, 0xFF, &store_l, &store_r);
+        store_avx512(arr, v2, pv, 0xFF, &store_l, &store_r);
+        store_avx512(arr, v3, pv, 0xFF, &store_l, &store_r);
+    }
+    while (read_r - read_l >= 8) {
+        unsigned long pos = next_read(&read_l, &read_r, store_l, store_r, 8);
+        store_avx512(arr, _mm512_loadu_si512(arr + pos), pv, 0xFF, &store_l, &store_r);
+    }
+
+    __mmask8 rest = (__mmask8) ((1u << (read_r - read_l)) - 1);
+    store_avx512(arr, _mm512_maskz_loadu_epi64(rest, arr + read_l), pv, rest, &store_l, &store_r);
+    for (unsigned i = 0; i < 2 * VECTOR_UNROLL; i++)
+        store_avx512(arr, saved[i], pv, 0xFF, &store_l, &store_r);
+    return store_l;
+}
+
+#endif
+
+static const struct {
+    const char *name;
+    SplitFn fn;
+} kernels[] = {
+    [PARTITION_SCALAR] = { "scalar", split_scalar },
+    [PARTITION_BLOCK] = { "block", split_block },
+#if defined(__x86_64__)
+    [PARTITION_AVX2] = { "avx2", split_avx2 },
+    [PARTITION_AVX512] = { "avx512", split_avx512 },
+#else
+    [PARTITION_AVX2] = { "avx2", NULL },
+    [PARTITION_AVX512] = { "avx512", NULL },
+#endif
+};
+
+static enum PartitionKernel current = PARTITION_BLOCK;
+static SplitFn split_fn = split_block;
+
+int partition_kernel_available(enum PartitionKernel kernel) {
+    switch (kernel) {
+    case PARTITION_SCALAR:
+    case PARTITION_BLOCK:
+        return 1;
+#if defined(__x86_64__)
+    case PARTITION_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    case PARTITION_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return 0;
+    }
+}
+
+int partition_kernel_use(enum PartitionKernel kernel) {
+    if (!partition_kernel_available(kernel))
+        return 0;
+    current = kernel;
+    split_fn = kernels[kernel].fn;
+    return 1;
+}
+
+enum PartitionKernel partition_kernel_current(void) {
+    return current;
+}
+
+const char *partition_kernel_name(enum PartitionKernel kernel) {
+    return kernels[kernel].name;
+}
+
+__attribute__((constructor))
+static void partition_dispatch(void) {
+#if defined(__x86_64__)
+    init_avx2_tables();
+#endif
+    if (!partition_kernel_use(PARTITION_AVX512) && !partition_kernel_use(PARTITION_AVX2))
+        partition_kernel_use(PARTITION_BLOCK);
+}
+
+unsigned long partition_split(int64_t *arr, unsigned long n, int64_t pivot, int equal_left) {
+    // x <= pivot is x < pivot + 1, unless nothing is larger than pivot
+    if (equal_left) {
+        if (pivot == INT64_MAX)
+            return n;
+        pivot++;
+    }
+    return split_fn(arr, n, pivot);
+}
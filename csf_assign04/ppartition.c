@@ -0,0 +1,210 @@
+// Parallel three-way partition for the top levels of the recursion.
+//
+// A range is split into one chunk per thread and every thread
+// partitions its chunk in place. Afterwards the elements on the wrong
+// side of the global split point form at most one interval per chunk
+// on each side, and there are equally many of them on both sides. The
+// k-th misplaced element on the left is swapped with the k-th on the
+// right, with the swaps divided evenly between the threads. The
+// three-way split is two such passes: by x < pivot over the whole
+// range, then by x <= pivot over the right part.
+//
+// Chunks, and ranges too short to be worth splitting between threads,
+// are partitioned by the fastest kernel in partkernel.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "parsort.h"
+
+// Thread count and array size set by partition_configure
+static unsigned config_threads = 1;
+static unsigned long config_total = 0;
+
+typedef struct {
+    unsigned long start, end;
+} Interval;
+
+typedef struct PartitionJob PartitionJob;
+
+typedef struct {
+    PartitionJob *job;
+    unsigned id;
+    unsigned long start, end;   // this thread's chunk
+    unsigned long split;        // end of the chunk's left part
+    pthread_t thread;
+} PartitionWorker;
+
+struct PartitionJob {
+    int64_t *arr;
+    int64_t pivot;
+    int equal_left;             // partition by x <= pivot instead of x < pivot
+    unsigned num_threads;
+    PartitionWorker *workers;
+
+    // misplaced elements left and right of the split, in order
+    Interval *left, *right;
+    unsigned num_left, num_right;
+    unsigned long num_swaps;
+};
+
+void partition_configure(unsigned num_threads, unsigned long total) {
+    config_threads = num_threads > 0 ? num_threads : 1;
+    config_total = total;
+}
+
+// Threads for a range of len elements: its share of the configured
+// threads, so that the ranges at one level of the recursion together
+// use about all of them.
+static unsigned partition_threads(unsigned long len) {
+    if (config_threads < 2 || len < PARALLEL_PARTITION_MIN || config_total == 0)
+        return 1;
+    unsigned long threads = (unsigned long) ((double) config_threads * len / config_total + 0.5);
+    unsigned long max_threads = len / (PARALLEL_PARTITION_MIN / 2);
+    if (threads > max_threads)
+        threads = max_threads;
+    if (threads > config_threads)
+        threads = config_threads;
+    return threads < 2 ? 1 : (unsigned) threads;
+}
+
+static void *partition_chunk(void *arg) {
+    PartitionWorker *self = arg;
+    PartitionJob *job = self->job;
+    self->split = self->start + partition_split(job->arr + self->start, self->end - self->start,
+                                                job->pivot, job->equal_left);
+    return NULL;
+}
+
+// Perform this thread's share of the swaps between misplaced elements
+static void *swap_misplaced(void *arg) {
+    PartitionWorker *self = arg;
+    PartitionJob *job = self->job;
+    unsigned long first = job->num_swaps * self->id / job->num_threads;
+    unsigned long last = job->num_swaps * (self->id + 1) / job->num_threads;
+    if (first == last)
+        return NULL;
+
+    // find the positions of the first-th misplaced element on each side
+    unsigned l = 0, r = 0;
+    unsigned long l_pos, r_pos, skip = first;
+    while (skip >= job->left[l].end - job->left[l].start) {
+        skip -= job->left[l].end - job->left[l].start;
+        l++;
+    }
+    l_pos = job->left[l].start + skip;
+    skip = first;
+    while (skip >= job->right[r].end - job->right[r].start) {
+        skip -= job->right[r].end - job->right[r].start;
+        r++;
+    }
+    r_pos = job->right[r].start + skip;
+
+    int64_t *arr = job->arr;
+    for (unsigned long k = first; k < last; k++) {
+        int64_t tmp = arr[l_pos];
+        arr[l_pos] = arr[r_pos];
+        arr[r_pos] = tmp;
+        if (++l_pos == job->left[l].end && k + 1 < last)
+            l_pos = job->left[++l].start;
+        if (++r_pos == job->right[r].end && k + 1 < last)
+            r_pos = job->right[++r].start;
+    }
+    return NULL;
+}
+
+// Run fn on every worker, the caller taking worker 0. A worker whose
+// thread can't be created is run by the caller afterwards.
+static void run_workers(PartitionJob *job, void *(*fn)(void *)) {
+    int *started = calloc(job->num_threads, sizeof(int));
+    for (unsigned t = 1; t < job->num_threads; t++) {
+        PartitionWorker *w = &job->workers[t];
+        if (started != NULL)
+            started[t] = pthread_create(&w->thread, NULL, fn, w) == 0;
+    }
+    fn(&job->workers[0]);
+    for (unsigned t = 1; t < job->num_threads; t++) {
+        PartitionWorker *w = &job->workers[t];
+        if (started != NULL && started[t])
+            pthread_join(w->thread, NULL);
+        else
+            fn(w);
+    }
+    free(started);
+}
+
+// Partition arr[start, end) so that elements satisfying the predicate
+// come first. Returns the index of the first element that doesn't.
+static unsigned long parallel_split(PartitionJob *job, unsigned long start, unsigned long end) {
+    unsigned nt = job->num_threads;
+    unsigned long len = end - start;
+    for (unsigned t = 0; t < nt; t++) {
+        job->workers[t].start = start + len * t / nt;
+        job->workers[t].end = start + len * (t + 1) / nt;
+    }
+    run_workers(job, partition_chunk);
+
+    unsigned long split = start;
+    for (unsigned t = 0; t < nt; t++)
+        split += job->workers[t].split - job->workers[t].start;
+
+    // elements failing the predicate before split, and passing it after
+    job->num_left = job->num_right = 0;
+    job->num_swaps = 0;
+    for (unsigned t = 0; t < nt; t++) {
+        PartitionWorker *w = &job->workers[t];
+        if (w->split < split && w->split < w->end) {
+            Interval iv = { w->split, w->end < split ? w->end : split };
+            job->left[job->num_left++] = iv;
+            job->num_swaps += iv.end - iv.start;
+        }
+        if (w->split > split && w->start < w->split) {
+            Interval iv = { w->start > split ? w->start : split, w->split };
+            job->right[job->num_right++] = iv;
+        }
+    }
+    if (job->num_swaps > 0)
+        run_workers(job, swap_misplaced);
+    return split;
+}
+
+void partition_range(int64_t *arr, unsigned long start, unsigned long end,
+                     unsigned long *eq_start, unsigned long *eq_end) {
+    prefetch_range(arr, start, end);
+    unsigned nt = partition_threads(end - start);
+    PartitionJob job;
+    job.workers = NULL;
+    job.left = job.right = NULL;
+    if (nt > 1) {
+        job.workers = calloc(nt, sizeof(PartitionWorker));
+        job.left = calloc(nt, sizeof(Interval));
+        job.right = calloc(nt, sizeof(Interval));
+    }
+    if (job.workers == NULL || job.left == NULL || job.right == NULL) {
+        free(job.workers);
+        free(job.left);
+        free(job.right);
+        int64_t pivot = arr[choose_pivot(arr, start, end)];
+        *eq_start = start + partition_split(arr + start, end - start, pivot, 0);
+        *eq_end = *eq_start + partition_split(arr + *eq_start, end - *eq_start, pivot, 1);
+        return;
+    }
+
+    job.arr = arr;
+    job.pivot = arr[choose_pivot(arr, start, end)];
+    job.num_threads = nt;
+    for (unsigned t = 0; t < nt; t++) {
+        job.workers[t].job = &job;
+        job.workers[t].id = t;
+    }
+
+    // the pivot is in the range, so the equal part is never empty
+    job.equal_left = 0;
+    *eq_start = parallel_split(&job, start, end);
+    job.equal_left = 1;
+    *eq_end = parallel_split(&job, *eq_start, end);
+
+    free(job.workers);
+    free(job.left);
+    free(job.right);
+}
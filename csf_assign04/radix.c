@@ -0,0 +1,250 @@
+// Parallel LSD radix sort for int64_t keys.
+//
+// Keys are sorted as unsigned values with the sign bit flipped, 11 bits
+// per pass (6 passes). Every pass has three phases separated by barriers:
+// each thread builds a histogram of its chunk, each thread computes
+// where its chunk's elements go in every bucket, and each thread then
+// scatters its chunk into the scratch buffer. Passes where every key
+// has the same digit are skipped. An optional payload array is
+// scattered along with the keys; the sort is stable.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "parsort.h"
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES ((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+typedef struct RadixJob RadixJob;
+
+typedef struct {
+    RadixJob *job;
+    unsigned id;
+    unsigned long start, end;            // this thread's chunk
+    unsigned long hist[RADIX_BUCKETS];
+    unsigned long offset[RADIX_BUCKETS];
+    pthread_t thread;
+} RadixWorker;
+
+struct RadixJob {
+    int64_t *arr, *scratch;
+    uint64_t *payload, *payload_scratch;   // moved along with the keys, or NULL
+    unsigned long n;
+    unsigned num_threads;
+    RadixWorker *workers;
+    pthread_barrier_t barrier;
+
+    // workers wait here until the pool size and chunks are final
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate_cond;
+    int gate_open;
+};
+
+static inline unsigned digit(int64_t x, unsigned pass) {
+    uint64_t key = (uint64_t) x ^ (1ULL << 63);
+    return (key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+}
+
+static void *radix_worker(void *arg) {
+    RadixWorker *self = arg;
+    RadixJob *job = self->job;
+
+    pthread_mutex_lock(&job->gate_lock);
+    while (!job->gate_open)
+        pthread_cond_wait(&job->gate_cond, &job->gate_lock);
+    pthread_mutex_unlock(&job->gate_lock);
+    if (self->id != 0)
+        numa_bind_worker(self->id, job->num_threads);
+
+    int64_t *src = job->arr, *dst = job->scratch;
+    uint64_t *psrc = job->payload, *pdst = job->payload_scratch;
+
+    for (unsigned pass = 0; pass < RADIX_PASSES; pass++) {
+        // Phase 1: histogram of this thread's chunk
+        memset(self->hist, 0, sizeof(self->hist));
+        for (unsigned long i = self->start; i < self->end; i++)
+            self->hist[digit(src[i], pass)]++;
+        pthread_barrier_wait(&job->barrier);
+
+        // Phase 2: this thread's offset in bucket b is everything in
+        // smaller buckets plus bucket b of the threads before it. Every
+        // thread sees the same totals, so they all agree on skipping.
+        unsigned long base = 0;
+        int skip = 0;
+        for (unsigned b = 0; b < RADIX_BUCKETS; b++) {
+            unsigned long total = 0;
+            for (unsigned t = 0; t < job->num_threads; t++) {
+                if (t == self->id)
+                    self->offset[b] = base + total;
+                total += job->workers[t].hist[b];
+            }
+            if (total == job->n)
+                skip = 1;
+            base += total;
+        }
+        if (skip) {
+            pthread_barrier_wait(&job->barrier);
+            continue;
+        }
+
+        // Phase 3: scatter
+        unsigned long *offset = self->offset;
+        if (psrc == NULL) {
+            for (unsigned long i = self->start; i < self->end; i++) {
+                int64_t x = src[i];
+                dst[offset[digit(x, pass)]++] = x;
+            }
+        } else {
+            for (unsigned long i = self->start; i < self->end; i++) {
+                int64_t x = src[i];
+                unsigned long pos = offset[digit(x, pass)]++;
+                dst[pos] = x;
+                pdst[pos] = psrc[i];
+            }
+        }
+        // histograms are reused by the next pass, and dst becomes src
+        pthread_barrier_wait(&job->barrier);
+
+        int64_t *tmp = src;
+        src = dst;
+        dst = tmp;
+        uint64_t *ptmp = psrc;
+        psrc = pdst;
+        pdst = ptmp;
+    }
+
+    // After an odd number of scatters the data is in scratch
+    if (src != job->arr) {
+        memcpy(job->arr + self->start, src + self->start,
+               (self->end - self->start) * sizeof(int64_t));
+        if (psrc != NULL)
+            memcpy(job->payload + self->start, psrc + self->start,
+                   (self->end - self->start) * sizeof(uint64_t));
+    }
+    return NULL;
+}
+
+int64_t *alloc_scratch(unsigned long n, const char *scratch_dir, int *is_mapped) {
+    size_t bytes = n * sizeof(int64_t);
+    *is_mapped = 0;
+    if (bytes <= available_memory()) {
+        int64_t *buf = malloc(bytes);
+        if (buf != NULL)
+            return buf;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/parsort-scratch-XXXXXX", scratch_dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Error: can't create scratch file in '%s'\n", scratch_dir);
+        return NULL;
+    }
+    unlink(path);
+    if (ftruncate(fd, bytes) != 0) {
+        fprintf(stderr, "Error: can't size scratch file\n");
+        close(fd);
+        return NULL;
+    }
+    void *buf = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "Error: can't map scratch file\n");
+        return NULL;
+    }
+    *is_mapped = 1;
+    return buf;
+}
+
+void free_scratch(int64_t *scratch, unsigned long n, int is_mapped) {
+    if (is_mapped)
+        munmap(scratch, n * sizeof(int64_t));
+    else
+        free(scratch);
+}
+
+int radix_sort_int64(int64_t *arr, unsigned long n, unsigned num_threads,
+                     const char *scratch_dir) {
+    return radix_sort_int64_payload(arr, NULL, n, num_threads, scratch_dir);
+}
+
+int radix_sort_int64_payload(int64_t *arr, uint64_t *payload, unsigned long n,
+                             unsigned num_threads, const char *scratch_dir) {
+    if (n < 2)
+        return 1;
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > n)
+        num_threads = n;
+
+    int is_mapped, payload_is_mapped = 0;
+    int64_t *scratch = alloc_scratch(n, scratch_dir, &is_mapped);
+    if (scratch == NULL)
+        return 0;
+    int64_t *payload_scratch = NULL;
+    if (payload != NULL) {
+        payload_scratch = alloc_scratch(n, scratch_dir, &payload_is_mapped);
+        if (payload_scratch == NULL) {
+            free_scratch(scratch, n, is_mapped);
+            return 0;
+        }
+    }
+
+    RadixJob job = { .arr = arr, .scratch = scratch, .n = n, .gate_open = 0,
+                     .payload = payload, .payload_scratch = (uint64_t *) payload_scratch };
+    job.workers = calloc(num_threads, sizeof(RadixWorker));
+    if (job.workers == NULL) {
+        fprintf(stderr, "Error: can't allocate radix workers\n");
+        free_scratch(scratch, n, is_mapped);
+        if (payload_scratch != NULL)
+            free_scratch(payload_scratch, n, payload_is_mapped);
+        return 0;
+    }
+    pthread_mutex_init(&job.gate_lock, NULL);
+    pthread_cond_init(&job.gate_cond, NULL);
+
+    // Start the helper threads; if one can't be created the sort goes
+    // ahead with the threads that exist
+    unsigned started = 1;
+    for (unsigned t = 1; t < num_threads; t++) {
+        job.workers[t].job = &job;
+        if (pthread_create(&job.workers[t].thread, NULL, radix_worker, &job.workers[t]) != 0) {
+            fprintf(stderr, "Warning: pthread_create failed\n");
+            break;
+        }
+        started++;
+    }
+
+    job.num_threads = started;
+    pthread_barrier_init(&job.barrier, NULL, started);
+    for (unsigned t = 0; t < started; t++) {
+        RadixWorker *w = &job.workers[t];
+        w->job = &job;
+        w->id = t;
+        w->start = n / started * t;
+        w->end = (t == started - 1) ? n : n / started * (t + 1);
+    }
+
+    pthread_mutex_lock(&job.gate_lock);
+    job.gate_open = 1;
+    pthread_cond_broadcast(&job.gate_cond);
+    pthread_mutex_unlock(&job.gate_lock);
+
+    radix_worker(&job.workers[0]);
+    for (unsigned t = 1; t < started; t++)
+        pthread_join(job.workers[t].thread, NULL);
+
+    pthread_barrier_destroy(&job.barrier);
+    pthread_cond_destroy(&job.gate_cond);
+    pthread_mutex_destroy(&job.gate_lock);
+    free(job.workers);
+    free_scratch(scratch, n, is_mapped);
+    if (payload_scratch != NULL)
+        free_scratch(payload_scratch, n, payload_is_mapped);
+    return 1;
+}
@@ -0,0 +1,124 @@
+// Sorting fixed-size records by an int64_t key.
+//
+// Records are never moved while sorting. The key of every record and
+// the record's index are copied into two arrays, which are sorted
+// together by the radix sort, or by the merge sort with -a merge (the
+// index rides along as payload). Both sorts are stable, so records
+// with equal keys keep their input order. A permutation pass then
+// gathers the records in key order into a scratch buffer. Each thread
+// fills a contiguous part of the output: its writes are sequential and
+// it prefetches the source records a few entries ahead. Finally the
+// sorted records are copied back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parsort.h"
+
+// Records the permutation pass prefetches ahead of the one it copies
+#define PREFETCH_DISTANCE 8
+
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dst;
+    const uint64_t *order;      // order[i]: index of the i-th record in key order
+    size_t record_size;
+    unsigned long start, end;   // output records of this thread
+    pthread_t thread;
+} GatherWorker;
+
+static void *gather_records(void *arg) {
+    GatherWorker *w = arg;
+    size_t size = w->record_size;
+    for (unsigned long i = w->start; i < w->end; i++) {
+        if (i + PREFETCH_DISTANCE < w->end)
+            __builtin_prefetch(w->src + w->order[i + PREFETCH_DISTANCE] * size);
+        memcpy(w->dst + i * size, w->src + w->order[i] * size, size);
+    }
+    return NULL;
+}
+
+static void *copy_back(void *arg) {
+    GatherWorker *w = arg;
+    size_t size = w->record_size;
+    memcpy(w->dst + w->start * size, w->src + w->start * size, (w->end - w->start) * size);
+    return NULL;
+}
+
+// Run fn for every worker, the caller taking worker 0 and any worker
+// whose thread can't be created
+static void run_gather_workers(GatherWorker *workers, unsigned num_threads, void *(*fn)(void *)) {
+    int started[num_threads];
+    for (unsigned t = 1; t < num_threads; t++)
+        started[t] = pthread_create(&workers[t].thread, NULL, fn, &workers[t]) == 0;
+    fn(&workers[0]);
+    for (unsigned t = 1; t < num_threads; t++) {
+        if (started[t])
+            pthread_join(workers[t].thread, NULL);
+        else
+            fn(&workers[t]);
+    }
+}
+
+int sort_records(unsigned char *data, unsigned long num_records,
+                 const struct Options *opts, const char *scratch_dir) {
+    size_t size = opts->record_size;
+    if (num_records < 2)
+        return 1;
+
+    int64_t *keys = malloc(num_records * sizeof(int64_t));
+    uint64_t *order = malloc(num_records * sizeof(uint64_t));
+    if (keys == NULL || order == NULL) {
+        fprintf(stderr, "Error: can't allocate record keys\n");
+        free(keys);
+        free(order);
+        return 0;
+    }
+    for (unsigned long i = 0; i < num_records; i++) {
+        memcpy(&keys[i], data + i * size + opts->key_offset, sizeof(int64_t));
+        order[i] = i;
+    }
+
+    int ok = opts->algorithm == ALGO_MERGE
+        ? merge_sort_int64_payload(keys, order, num_records, opts->num_threads, scratch_dir)
+        : radix_sort_int64_payload(keys, order, num_records, opts->num_threads, scratch_dir);
+    free(keys);
+    if (!ok) {
+        free(order);
+        return 0;
+    }
+
+    // Scratch space for the whole file, in units of int64_t
+    unsigned long scratch_elements = (num_records * size + sizeof(int64_t) - 1) / sizeof(int64_t);
+    int is_mapped;
+    unsigned char *sorted = (unsigned char *) alloc_scratch(scratch_elements, scratch_dir, &is_mapped);
+    if (sorted == NULL) {
+        free(order);
+        return 0;
+    }
+
+    unsigned nt = opts->num_threads > 0 ? opts->num_threads : 1;
+    if (nt > num_records)
+        nt = num_records;
+    GatherWorker workers[nt];
+    for (unsigned t = 0; t < nt; t++) {
+        workers[t].src = data;
+        workers[t].dst = sorted;
+        workers[t].order = order;
+        workers[t].record_size = size;
+        workers[t].start = num_records * t / nt;
+        workers[t].end = num_records * (t + 1) / nt;
+    }
+    run_gather_workers(workers, nt, gather_records);
+
+    for (unsigned t = 0; t < nt; t++) {
+        workers[t].src = sorted;
+        workers[t].dst = data;
+    }
+    run_gather_workers(workers, nt, copy_back);
+
+    free_scratch((int64_t *) sorted, scratch_elements, is_mapped);
+    free(order);
+    return 1;
+}
@@ -0,0 +1,21 @@
+#! /usr/bin/env bash
+
+# Time parsort on inputs that stress pivot selection and duplicate
+# handling. Usage: ./run_patterns.sh [size] [par threshold] [parsort options...]
+
+set -e
+
+size=${1:-16M}
+threshold=${2:-1048576}
+shift $(( $# < 2 ? $# : 2 ))
+
+make parsort is_sorted gen_pattern_data
+dir=/tmp/$(whoami)
+mkdir -p $dir
+for pattern in random sorted reverse equal fewunique organpipe; do
+  echo "Pattern $pattern ($size, threshold $threshold)"
+  ./gen_pattern_data $pattern $size $dir/pattern_$size.in > /dev/null
+  time ./parsort "$@" $dir/pattern_$size.in $threshold
+  ./is_sorted $dir/pattern_$size.in
+done
+rm -rf $dir
@@ -0,0 +1,230 @@
+// Parallel sample sort for int64_t keys.
+//
+// Splitters taken from a sorted random sample divide the key range into
+// BUCKETS_PER_THREAD buckets per thread. Each thread classifies its
+// chunk and counts elements per bucket. From the counts every thread
+// knows where its elements of each bucket go, and it scatters its chunk
+// into the scratch buffer so that every bucket is one contiguous region.
+// The threads then claim buckets one at a time, sort them with
+// sort_int64 and copy them back. There is a single distribution step
+// instead of a tree of partitions, so all threads are busy from the
+// start. Having more buckets than threads evens out the load when the
+// buckets differ in size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "parsort.h"
+
+#define BUCKETS_PER_THREAD 4
+
+// Sample elements per bucket; more gives more even buckets
+#define OVERSAMPLE 64
+
+// Below this many elements per thread, sort sequentially
+#define SAMPLE_SORT_MIN_PER_THREAD 4096
+
+typedef struct SampleJob SampleJob;
+
+typedef struct {
+    SampleJob *job;
+    unsigned id;
+    unsigned long start, end;   // this thread's chunk
+    unsigned long *count;       // elements per bucket in the chunk
+    pthread_t thread;
+} SampleWorker;
+
+struct SampleJob {
+    int64_t *arr, *scratch;
+    unsigned long n;
+    unsigned num_threads, num_buckets;
+    const int64_t *splitters;      // num_buckets - 1 ascending keys
+    unsigned long *bucket_start;   // num_buckets + 1 offsets into scratch
+    atomic_uint next_bucket;
+    SampleWorker *workers;
+    pthread_barrier_t barrier;
+
+    // workers wait here until the pool size and chunks are final
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate_cond;
+    int gate_open;
+};
+
+// Bucket of x: the number of splitters that are <= x
+static inline unsigned classify(const int64_t *splitters, unsigned num_splitters, int64_t x) {
+    const int64_t *base = splitters;
+    unsigned len = num_splitters;
+    while (len > 0) {
+        unsigned half = len / 2;
+        if (base[half] <= x) {
+            base += half + 1;
+            len -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    return base - splitters;
+}
+
+static void *sample_worker(void *arg) {
+    SampleWorker *self = arg;
+    SampleJob *job = self->job;
+
+    pthread_mutex_lock(&job->gate_lock);
+    while (!job->gate_open)
+        pthread_cond_wait(&job->gate_cond, &job->gate_lock);
+    pthread_mutex_unlock(&job->gate_lock);
+    if (self->id != 0)
+        numa_bind_worker(self->id, job->num_threads);
+
+    unsigned nb = job->num_buckets;
+    int64_t *arr = job->arr;
+
+    // Phase 1: count this chunk's elements per bucket
+    memset(self->count, 0, nb * sizeof(unsigned long));
+    for (unsigned long i = self->start; i < self->end; i++)
+        self->count[classify(job->splitters, nb - 1, arr[i])]++;
+    pthread_barrier_wait(&job->barrier);
+
+    // Phase 2: this thread's elements of bucket b go after everything in
+    // smaller buckets and after bucket b of the threads before it.
+    // count[] is turned into those offsets.
+    unsigned long base = 0;
+    unsigned long offset[nb];
+    for (unsigned b = 0; b < nb; b++) {
+        if (self->id == 0)
+            job->bucket_start[b] = base;
+        for (unsigned t = 0; t < job->num_threads; t++) {
+            if (t == self->id)
+                offset[b] = base;
+            base += job->workers[t].count[b];
+        }
+    }
+    if (self->id == 0)
+        job->bucket_start[nb] = base;
+
+    // Phase 3: scatter into the bucket regions of scratch
+    for (unsigned long i = self->start; i < self->end; i++) {
+        int64_t x = arr[i];
+        job->scratch[offset[classify(job->splitters, nb - 1, x)]++] = x;
+    }
+    pthread_barrier_wait(&job->barrier);
+
+    // Phase 4: sort whole buckets and copy them back
+    unsigned b;
+    while ((b = atomic_fetch_add(&job->next_bucket, 1)) < nb) {
+        unsigned long start = job->bucket_start[b], len = job->bucket_start[b + 1] - start;
+        sort_int64(job->scratch + start, len);
+        memcpy(arr + start, job->scratch + start, len * sizeof(int64_t));
+    }
+    return NULL;
+}
+
+// xorshift64* for picking sample positions
+static uint64_t next_rand(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Choose num_buckets - 1 splitters from a sorted random sample.
+// Returns NULL if memory can't be allocated.
+static int64_t *choose_splitters(const int64_t *arr, unsigned long n, unsigned num_buckets) {
+    unsigned long sample_size = (unsigned long) num_buckets * OVERSAMPLE;
+    int64_t *sample = malloc(sample_size * sizeof(int64_t));
+    int64_t *splitters = malloc(num_buckets * sizeof(int64_t));
+    if (sample == NULL || splitters == NULL) {
+        free(sample);
+        free(splitters);
+        return NULL;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ n;
+    for (unsigned long i = 0; i < sample_size; i++)
+        sample[i] = arr[next_rand(&state) % n];
+    sort_int64(sample, sample_size);
+    for (unsigned b = 1; b < num_buckets; b++)
+        splitters[b - 1] = sample[b * OVERSAMPLE];
+
+    free(sample);
+    return splitters;
+}
+
+int sample_sort_int64(int64_t *arr, unsigned long n, unsigned num_threads,
+                      const char *scratch_dir) {
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads == 1 || n / num_threads < SAMPLE_SORT_MIN_PER_THREAD) {
+        sort_int64(arr, n);
+        return 1;
+    }
+
+    int is_mapped;
+    int64_t *scratch = alloc_scratch(n, scratch_dir, &is_mapped);
+    if (scratch == NULL)
+        return 0;
+
+    SampleJob job = { .arr = arr, .scratch = scratch, .n = n, .gate_open = 0 };
+    job.num_buckets = num_threads * BUCKETS_PER_THREAD;
+    job.splitters = choose_splitters(arr, n, job.num_buckets);
+    job.bucket_start = malloc((job.num_buckets + 1) * sizeof(unsigned long));
+    job.workers = calloc(num_threads, sizeof(SampleWorker));
+    unsigned long *counts = malloc((size_t) num_threads * job.num_buckets * sizeof(unsigned long));
+    if (job.splitters == NULL || job.bucket_start == NULL || job.workers == NULL || counts == NULL) {
+        fprintf(stderr, "Error: can't allocate sample sort workers\n");
+        free((void *) job.splitters);
+        free(job.bucket_start);
+        free(job.workers);
+        free(counts);
+        free_scratch(scratch, n, is_mapped);
+        return 0;
+    }
+    atomic_init(&job.next_bucket, 0);
+    pthread_mutex_init(&job.gate_lock, NULL);
+    pthread_cond_init(&job.gate_cond, NULL);
+
+    // Start the helper threads; if one can't be created the sort goes
+    // ahead with the threads that exist
+    unsigned started = 1;
+    for (unsigned t = 1; t < num_threads; t++) {
+        job.workers[t].job = &job;
+        if (pthread_create(&job.workers[t].thread, NULL, sample_worker, &job.workers[t]) != 0) {
+            fprintf(stderr, "Warning: pthread_create failed\n");
+            break;
+        }
+        started++;
+    }
+
+    job.num_threads = started;
+    pthread_barrier_init(&job.barrier, NULL, started);
+    for (unsigned t = 0; t < started; t++) {
+        SampleWorker *w = &job.workers[t];
+        w->job = &job;
+        w->id = t;
+        w->start = n / started * t;
+        w->end = (t == started - 1) ? n : n / started * (t + 1);
+        w->count = counts + (size_t) t * job.num_buckets;
+    }
+
+    pthread_mutex_lock(&job.gate_lock);
+    job.gate_open = 1;
+    pthread_cond_broadcast(&job.gate_cond);
+    pthread_mutex_unlock(&job.gate_lock);
+
+    sample_worker(&job.workers[0]);
+    for (unsigned t = 1; t < started; t++)
+        pthread_join(job.workers[t].thread, NULL);
+
+    pthread_barrier_destroy(&job.barrier);
+    pthread_cond_destroy(&job.gate_cond);
+    pthread_mutex_destroy(&job.gate_lock);
+    free((void *) job.splitters);
+    free(job.bucket_start);
+    free(job.workers);
+    free(counts);
+    free_scratch(scratch, n, is_mapped);
+    return 1;
+}
@@ -0,0 +1,169 @@
+// Selection without a full sort (--select and --top).
+//
+// --select=K is a quickselect. The range holding index K is split with
+// partition_range, the same three-way partition the quicksort uses (and
+// parallel for large ranges), and only the side containing K is kept.
+// It stops as soon as K falls among the keys equal to the pivot. The
+// expected work is linear. The file is left partitioned around K: the
+// keys before it are no larger and the keys after it no smaller.
+//
+// --top=K doesn't modify the file. Every thread scans one chunk and
+// keeps the K smallest keys it has seen in a max-heap, so most keys cost
+// a single comparison with the heap's root. The heaps are then combined
+// and the K smallest keys sorted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parsort.h"
+
+// Ranges this short are finished with the leaf sort
+#define SELECT_LEAF 32
+
+typedef struct {
+    const int64_t *arr;
+    unsigned long start, end;   // chunk of this thread
+    int64_t *heap;              // max-heap of the smallest keys seen
+    unsigned long capacity, size;
+    pthread_t thread;
+} TopWorker;
+
+static void sift_down(int64_t *heap, unsigned long size, unsigned long i) {
+    int64_t x = heap[i];
+    for (;;) {
+        unsigned long child = 2 * i + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && heap[child + 1] > heap[child])
+            child++;
+        if (heap[child] <= x)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = x;
+}
+
+static void sift_up(int64_t *heap, unsigned long i) {
+    int64_t x = heap[i];
+    while (i > 0 && heap[(i - 1) / 2] < x) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = x;
+}
+
+static void *top_chunk(void *arg) {
+    TopWorker *w = arg;
+    int64_t *heap = w->heap;
+    unsigned long size = 0, capacity = w->capacity;
+    for (unsigned long i = w->start; i < w->end; i++) {
+        int64_t x = w->arr[i];
+        if (size < capacity) {
+            heap[size] = x;
+            sift_up(heap, size++);
+        } else if (x < heap[0]) {
+            heap[0] = x;
+            sift_down(heap, size, 0);
+        }
+    }
+    w->size = size;
+    return NULL;
+}
+
+static int64_t select_nth(int64_t *arr, unsigned long n, unsigned long k) {
+    unsigned long start = 0, end = n;
+    while (end - start > SELECT_LEAF) {
+        unsigned long eq_start, eq_end;
+        partition_range(arr, start, end, &eq_start, &eq_end);
+        if (k < eq_start)
+            end = eq_start;
+        else if (k >= eq_end)
+            start = eq_end;
+        else
+            return arr[k];
+    }
+    sort_int64(arr + start, end - start);
+    return arr[k];
+}
+
+static unsigned long top_k(const int64_t *arr, unsigned long n, unsigned long k,
+                           unsigned num_threads, int64_t *out) {
+    if (k > n)
+        k = n;
+    if (k == 0)
+        return 0;
+    unsigned nt = num_threads > 0 ? num_threads : 1;
+    if (nt > n)
+        nt = n;
+
+    TopWorker workers[nt];
+    int started[nt];
+    unsigned long total_capacity = 0;
+    for (unsigned t = 0; t < nt; t++) {
+        TopWorker *w = &workers[t];
+        w->arr = arr;
+        w->start = n * t / nt;
+        w->end = n * (t + 1) / nt;
+        w->capacity = k < w->end - w->start ? k : w->end - w->start;
+        total_capacity += w->capacity;
+    }
+    int64_t *heaps = malloc(total_capacity * sizeof(int64_t));
+    if (heaps == NULL) {
+        fprintf(stderr, "Error: can't allocate top-k heaps\n");
+        return 0;
+    }
+    unsigned long offset = 0;
+    for (unsigned t = 0; t < nt; t++) {
+        workers[t].heap = heaps + offset;
+        offset += workers[t].capacity;
+    }
+
+    for (unsigned t = 1; t < nt; t++)
+        started[t] = pthread_create(&workers[t].thread, NULL, top_chunk, &workers[t]) == 0;
+    top_chunk(&workers[0]);
+    for (unsigned t = 1; t < nt; t++) {
+        if (started[t])
+            pthread_join(workers[t].thread, NULL);
+        else
+            top_chunk(&workers[t]);
+    }
+
+    // Every heap is full (capacity elements), so the heaps are contiguous
+    sort_int64(heaps, total_capacity);
+    memcpy(out, heaps, k * sizeof(int64_t));
+    free(heaps);
+    return k;
+}
+
+int run_select(int64_t *arr, unsigned long n, const struct Options *opts) {
+    if (n == 0) {
+        fprintf(stderr, "Error: the file is empty\n");
+        return 0;
+    }
+    unsigned long k = opts->select_k == SELECT_MEDIAN ? (n - 1) / 2 : opts->select_k;
+
+    if (opts->select == SELECT_NTH) {
+        if (k >= n) {
+            fprintf(stderr, "Error: --select=%lu is out of range for %lu elements\n", k, n);
+            return 0;
+        }
+        partition_configure(opts->num_threads, n);
+        print_key(stdout, select_nth(arr, n, k), opts->key_type);
+        return 1;
+    }
+
+    if (k > n)
+        k = n;
+    int64_t *smallest = malloc((k > 0 ? k : 1) * sizeof(int64_t));
+    if (smallest == NULL) {
+        fprintf(stderr, "Error: can't allocate %lu results\n", k);
+        return 0;
+    }
+    unsigned long count = top_k(arr, n, k, opts->num_threads, smallest);
+    for (unsigned long i = 0; i < count; i++)
+        print_key(stdout, smallest[i], opts->key_type);
+    free(smallest);
+    return count == k;
+}
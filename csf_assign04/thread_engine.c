@@ -0,0 +1,248 @@
+// Thread engine for parsort: a fixed pool of pthreads sorts the mapping
+// in place. Each worker owns a deque of unsorted (start, end) ranges.
+// It partitions the range in hand, pushes the larger half onto the
+// bottom of its deque, and keeps going with the smaller half. Idle
+// workers steal from the top of other workers' deques, so they take
+// the oldest (largest) ranges.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "parsort.h"
+
+// An unsorted region of the array, start inclusive, end exclusive,
+// and the cutoff below which it is sorted without splitting
+typedef struct {
+    unsigned long start, end;
+    unsigned long threshold;
+} Range;
+
+// Double-ended queue of ranges. The owner pushes and pops at the tail;
+// thieves steal from the head.
+typedef struct {
+    pthread_mutex_t lock;
+    Range *items;
+    size_t head, tail, capacity;
+} Deque;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    unsigned id;
+    Deque deque;
+    pthread_t thread;
+} Worker;
+
+struct ThreadPool {
+    int64_t *arr;
+    unsigned long min_threshold;    // lowest adapted cutoff, 0 disables adapting
+    unsigned num_workers;
+    Worker *workers;
+    atomic_ulong pending;   // ranges that are not fully sorted yet
+    atomic_int failed;
+};
+
+static int deque_init(Deque *dq) {
+    dq->head = dq->tail = 0;
+    dq->capacity = 64;
+    dq->items = malloc(dq->capacity * sizeof(Range));
+    if (dq->items == NULL)
+        return 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 1;
+}
+
+static void deque_destroy(Deque *dq) {
+    pthread_mutex_destroy(&dq->lock);
+    free(dq->items);
+}
+
+// Push a range at the tail. Returns 0 if the deque could not grow.
+static int deque_push(Deque *dq, Range r) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->capacity) {
+        // reclaim the slots freed by steals before growing
+        size_t count = dq->tail - dq->head;
+        if (dq->head > 0) {
+            memmove(dq->items, dq->items + dq->head, count * sizeof(Range));
+        } else {
+            Range *items = realloc(dq->items, 2 * dq->capacity * sizeof(Range));
+            if (items == NULL) {
+                pthread_mutex_unlock(&dq->lock);
+                return 0;
+            }
+            dq->items = items;
+            dq->capacity *= 2;
+        }
+        dq->head = 0;
+        dq->tail = count;
+    }
+    dq->items[dq->tail++] = r;
+    pthread_mutex_unlock(&dq->lock);
+    return 1;
+}
+
+// Take a range from the tail (owner) or the head (thief).
+static int deque_take(Deque *dq, Range *r, int from_head) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *r = from_head ? dq->items[dq->head++] : dq->items[--dq->tail];
+        found = 1;
+        if (dq->head == dq->tail)
+            dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// Try to steal a range from any other worker, starting after self.
+static int steal(Worker *self, Range *r) {
+    ThreadPool *pool = self->pool;
+    for (unsigned i = 1; i < pool->num_workers; i++) {
+        Worker *victim = &pool->workers[(self->id + i) % pool->num_workers];
+        if (deque_take(&victim->deque, r, 1))
+            return 1;
+    }
+    return 0;
+}
+
+// Sort one range, splitting off work for other workers while it is
+// larger than the parallel threshold.
+static void sort_range(Worker *self, Range r) {
+    ThreadPool *pool = self->pool;
+
+    TraceSpan span;
+    while (r.end - r.start >= 2 && r.end - r.start > r.threshold) {
+        unsigned long eq_start, eq_end;
+        trace_begin(&span);
+        partition_range(pool->arr, r.start, r.end, &eq_start, &eq_end);
+        trace_end_partition(&span, r.start, r.end, eq_start, eq_end);
+        unsigned long left_len = eq_start - r.start, right_len = r.end - eq_end;
+        Range left = { r.start, eq_start, adapt_threshold(r.threshold, pool->min_threshold, left_len, right_len) };
+        Range right = { eq_end, r.end, adapt_threshold(r.threshold, pool->min_threshold, right_len, left_len) };
+        int left_larger = eq_start - r.start >= r.end - eq_end;
+        Range larger = left_larger ? left : right;
+        Range smaller = left_larger ? right : left;
+
+        atomic_fetch_add(&pool->pending, 1);
+        if (!deque_push(&self->deque, larger)) {
+            // couldn't publish it; sort it here instead
+            atomic_store(&pool->failed, 1);
+            atomic_fetch_sub(&pool->pending, 1);
+            trace_begin(&span);
+            sort_int64(pool->arr + larger.start, larger.end - larger.start);
+            trace_end(&span, "sort", larger.start, larger.end);
+        }
+        r = smaller;
+    }
+
+    if (r.end - r.start >= 2) {
+        trace_begin(&span);
+        sort_int64(pool->arr + r.start, r.end - r.start);
+        trace_end(&span, "sort", r.start, r.end);
+    }
+    atomic_fetch_sub(&pool->pending, 1);
+}
+
+static void *worker_main(void *arg) {
+    Worker *self = arg;
+    ThreadPool *pool = self->pool;
+    Range r;
+
+    if (self->id != 0)
+        numa_bind_worker(self->id, pool->num_workers);
+    trace_name("thread_name", "worker %u", self->id);
+
+    // idle: time spent looking for work, traced from the first failed
+    // attempt until a range is found
+    TraceSpan idle;
+    int idling = 0;
+    while (atomic_load(&pool->pending) > 0) {
+        if (deque_take(&self->deque, &r, 0) || steal(self, &r)) {
+            if (idling)
+                trace_end(&idle, "idle", r.start, r.end);
+            idling = 0;
+            sort_range(self, r);
+        } else {
+            if (!idling)
+                trace_begin(&idle);
+            idling = 1;
+            sched_yield();
+        }
+    }
+    if (idling)
+        trace_end(&idle, "idle", 0, 0);
+    if (self->id != 0)
+        trace_flush();
+    return NULL;
+}
+
+int quicksort_threads(int64_t *arr, unsigned long num_elements, unsigned long par_threshold,
+                      unsigned long min_threshold, unsigned num_threads) {
+    if (num_elements < 2)
+        return 1;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    ThreadPool pool;
+    pool.arr = arr;
+    pool.min_threshold = min_threshold;
+    pool.num_workers = num_threads;
+    atomic_init(&pool.pending, 1);
+    atomic_init(&pool.failed, 0);
+    pool.workers = calloc(num_threads, sizeof(Worker));
+    if (pool.workers == NULL) {
+        fprintf(stderr, "Error: can't allocate thread pool\n");
+        return 0;
+    }
+
+    unsigned initialized = 0;
+    for (; initialized < num_threads; initialized++) {
+        Worker *w = &pool.workers[initialized];
+        w->pool = &pool;
+        w->id = initialized;
+        if (!deque_init(&w->deque))
+            break;
+    }
+    if (initialized < num_threads) {
+        fprintf(stderr, "Error: can't allocate work deques\n");
+        for (unsigned i = 0; i < initialized; i++)
+            deque_destroy(&pool.workers[i].deque);
+        free(pool.workers);
+        return 0;
+    }
+
+    // Seed worker 0 with the whole array; the calling thread is worker 0
+    Range all = { 0, num_elements, par_threshold };
+    deque_push(&pool.workers[0].deque, all);
+
+    // If a thread can't be created the remaining workers still finish
+    // the sort (workers that never started have empty deques), so only
+    // the parallelism is reduced
+    unsigned started = 1;
+    for (unsigned i = 1; i < num_threads; i++) {
+        int rc = pthread_create(&pool.workers[i].thread, NULL, worker_main, &pool.workers[i]);
+        if (rc != 0) {
+            fprintf(stderr, "Warning: pthread_create failed: %s\n", strerror(rc));
+            break;
+        }
+        started++;
+    }
+
+    worker_main(&pool.workers[0]);
+
+    for (unsigned i = 1; i < started; i++)
+        pthread_join(pool.workers[i].thread, NULL);
+    for (unsigned i = 0; i < num_threads; i++)
+        deque_destroy(&pool.workers[i].deque);
+    free(pool.workers);
+
+    if (atomic_load(&pool.failed))
+        fprintf(stderr, "Warning: work deque allocation failed; some ranges sorted without splitting\n");
+    return 1;
+}
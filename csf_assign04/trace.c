@@ -0,0 +1,166 @@
+// Timeline trace of the quicksort engines (--trace=FILE).
+//
+// Events are written in the Chrome trace-event format (a JSON array of
+// objects) and can be opened in chrome://tracing or ui.perfetto.dev.
+// Every partition, leaf sort, fork, wait for a child and idle period is
+// a complete ("X") event with its process and thread id, so the fork
+// engine's processes and the thread engine's workers each get a row.
+// The args give the range, its length, the minor and major page faults
+// the thread took during the event, and for partitions the sizes of
+// both sides and the skew: the larger side's share of them (0.5 is a
+// perfect split, 1.0 means one side got everything).
+//
+// Each thread formats events into its own buffer and appends it to the
+// file with a single write when it fills up or the thread finishes. The
+// file is opened with O_APPEND, so buffers from different threads and
+// processes never interleave. Fork children inherit the parent's file
+// and clock origin; a child discards the buffer copied from its parent
+// and flushes its own when it exits.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include "parsort.h"
+
+#define TRACE_BUFFER_SIZE 16384
+
+// Longest formatted event
+#define TRACE_EVENT_MAX 512
+
+static int trace_fd = -1;
+static double trace_origin;
+
+static __thread char trace_buf[TRACE_BUFFER_SIZE];
+static __thread size_t trace_len;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(trace_fd, buf, len);
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+// Append one event (without the separator) to this thread's buffer
+static void trace_emit(const char *fmt, ...) {
+    if (trace_len + TRACE_EVENT_MAX > TRACE_BUFFER_SIZE)
+        trace_flush();
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(trace_buf + trace_len, TRACE_EVENT_MAX - 2, fmt, ap);
+    va_end(ap);
+    if (n < 0 || n >= TRACE_EVENT_MAX - 2)
+        return;
+    trace_len += n;
+    trace_buf[trace_len++] = ',';
+    trace_buf[trace_len++] = '\n';
+}
+
+static void discard_inherited_events(void) {
+    trace_len = 0;
+}
+
+int trace_open(const char *path) {
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (trace_fd < 0) {
+        fprintf(stderr, "Error: can't create trace file '%s'\n", path);
+        return 0;
+    }
+    trace_origin = now_us();
+    write_all("[\n", 2);
+    pthread_atfork(NULL, NULL, discard_inherited_events);
+    atexit(trace_flush);
+    trace_name("process_name", "parsort %d", (int) getpid());
+    return 1;
+}
+
+void trace_flush(void) {
+    if (trace_fd >= 0 && trace_len > 0)
+        write_all(trace_buf, trace_len);
+    trace_len = 0;
+}
+
+void trace_close(void) {
+    if (trace_fd < 0)
+        return;
+    trace_flush();
+    // the last event has no trailing comma, which makes the file valid JSON
+    char end[TRACE_EVENT_MAX];
+    int n = snprintf(end, sizeof(end), "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+                     "\"pid\":%d,\"tid\":%ld}\n]\n",
+                     now_us() - trace_origin, (int) getpid(), (long) syscall(SYS_gettid));
+    write_all(end, n);
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+void trace_name(const char *kind, const char *fmt, ...) {
+    if (trace_fd < 0)
+        return;
+    char name[128];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(name, sizeof(name), fmt, ap);
+    va_end(ap);
+    trace_emit("{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+               kind, (int) getpid(), (long) syscall(SYS_gettid), name);
+}
+
+void trace_begin(TraceSpan *span) {
+    if (trace_fd < 0)
+        return;
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    span->minflt = ru.ru_minflt;
+    span->majflt = ru.ru_majflt;
+    span->start = now_us();
+}
+
+// Write the event for span with extra args, given as a JSON fragment
+static void trace_span(const TraceSpan *span, const char *name, unsigned long start,
+                       unsigned long end, const char *extra) {
+    double stop = now_us();
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    trace_emit("{\"name\":\"%s\",\"cat\":\"parsort\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+               "\"pid\":%d,\"tid\":%ld,\"args\":{\"start\":%lu,\"end\":%lu,\"len\":%lu,"
+               "\"minflt\":%ld,\"majflt\":%ld%s}}",
+               name, span->start - trace_origin, stop - span->start,
+               (int) getpid(), (long) syscall(SYS_gettid), start, end, end - start,
+               ru.ru_minflt - span->minflt, ru.ru_majflt - span->majflt, extra);
+}
+
+void trace_end(const TraceSpan *span, const char *name, unsigned long start, unsigned long end) {
+    if (trace_fd < 0)
+        return;
+    trace_span(span, name, start, end, "");
+}
+
+void trace_end_partition(const TraceSpan *span, unsigned long start, unsigned long end,
+                         unsigned long eq_start, unsigned long eq_end) {
+    if (trace_fd < 0)
+        return;
+    unsigned long left = eq_start - start, right = end - eq_end;
+    unsigned long larger = left > right ? left : right;
+    double skew = left + right > 0 ? (double) larger / (left + right) : 0.5;
+    char extra[128];
+    snprintf(extra, sizeof(extra), ",\"left\":%lu,\"right\":%lu,\"equal\":%lu,\"skew\":%.3f",
+             left, right, eq_end - eq_start, skew);
+    trace_span(span, "partition", start, end, extra);
+}